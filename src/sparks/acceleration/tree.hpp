@@ -28,6 +28,8 @@ public:
 	BinaryTree(std::unique_ptr<ContentType> content) {
 		root_ = std::make_unique<Node >(std::move(content));
 	}
+	// Deep copy, every node and content allocated again
+	BinaryTree(const BinaryTree& tree) : root_{ CloneNode_(tree.root_.get()) } {}
 	Node* GetRoot() {
 		return root_.get();
 	}
@@ -59,6 +61,19 @@ public:
 	}
 private:
 	std::unique_ptr<Node > root_{nullptr};
+
+	static std::unique_ptr<Node> CloneNode_(const Node* node) {
+		if (node == nullptr) {
+			return nullptr;
+		}
+		auto clone = std::make_unique<Node>();
+		if (node->content) {
+			clone->content = std::make_unique<ContentType>(*node->content);
+		}
+		clone->left_child = CloneNode_(node->left_child.get());
+		clone->right_child = CloneNode_(node->right_child.get());
+		return clone;
+	}
 };
 
 } // namespace sparks
\ No newline at end of file
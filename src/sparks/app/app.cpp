@@ -214,11 +214,9 @@ void App::OnLoop() { // Operations to do in loop
 
 void App::OnUpdate(uint32_t ms) {
   if (envmap_require_configure_) {
-    renderer_->SafeOperation<void>([&]() {
-      renderer_->GetScene().UpdateEnvmapConfiguration();
-      renderer_->ResetAccumulation();
-      envmap_require_configure_ = false;
-    });
+    renderer_->GetScene().UpdateEnvmapConfiguration();
+    renderer_->ResetAccumulation();
+    envmap_require_configure_ = false;
   }
   UpdateImGui();
   UpdateDynamicBuffer();
@@ -236,6 +234,12 @@ void App::OnUpdate(uint32_t ms) {
       reset_accumulation_ = false;
     }
   }
+  if (app_settings_.resume && !app_settings_.hardware_renderer) {
+    // After the initial reset, which would discard the loaded accumulation
+    renderer_->LoadCheckpoint(
+        renderer_->GetRendererSettings().checkpoint_path);
+    app_settings_.resume = false;
+  }
   if (app_settings_.hardware_renderer) {
     UpdateTopLevelAccelerationStructure();
   }
@@ -472,6 +476,22 @@ void App::UpdateImGui() {
     } else {
       reset_accumulation_ |= ImGui::SliderInt(
           "Samples", &renderer_->GetRendererSettings().num_samples, 1, 16);
+      reset_accumulation_ |= ImGui::InputFloat(
+          "Time Budget (s)", &renderer_->GetRendererSettings().time_budget);
+      std::vector<const char *> integrators = {"Path", "Bidirectional",
+                                               "Photon Mapping"};
+      reset_accumulation_ |= ImGui::Combo(
+          "Integrator",
+          reinterpret_cast<int *>(&renderer_->GetRendererSettings().integrator),
+          integrators.data(), integrators.size());
+      if (renderer_->GetRendererSettings().integrator == INTEGRATOR_PPM) {
+        reset_accumulation_ |= ImGui::InputInt(
+            "Photons per Pass",
+            &renderer_->GetRendererSettings().photons_per_pass);
+        reset_accumulation_ |= ImGui::SliderFloat(
+            "Photon Radius", &renderer_->GetRendererSettings().photon_radius,
+            1e-4f, 1.0f, "%.4f", ImGuiSliderFlags_Logarithmic);
+      }
     }
     reset_accumulation_ |= ImGui::SliderInt(
         "Bounces", &renderer_->GetRendererSettings().num_bounces, 1, 128);
@@ -627,6 +647,9 @@ void App::UpdateImGui() {
       ImGui::Text("Primary Ray Rate: %.2f r/s", sample_rate);
     }
     ImGui::Text("Accumulated Samples: %d", current_sample);
+    if (!app_settings_.hardware_renderer && renderer_->IsBudgetExhausted()) {
+      ImGui::Text("Time Budget Exhausted");
+    }
     ImGui::Text("Cursor Position: (%d, %d)", cursor_x_, cursor_y_);
     ImGui::Text("R:%f G:%f B:%f", hovering_pixel_color_.x,
                 hovering_pixel_color_.y, hovering_pixel_color_.z);
@@ -1093,7 +1116,8 @@ void App::UpdateCamera() {
 void App::UploadAccumulationResult() {
   if (app_settings_.hardware_renderer) {
   } else {
-    renderer_->RetrieveAccumulationResult(
+    // The staging buffers persist, only copy what changed since last frame
+    renderer_->RetrieveAccumulationUpdate(
         reinterpret_cast<glm::vec4 *>(host_accumulation_color_->Map()),
         reinterpret_cast<float *>(host_accumulation_number_->Map()));
     host_accumulation_number_->Unmap();
@@ -7,5 +7,6 @@ struct AppSettings {
   bool validation_layer{};
   bool hardware_renderer{};
   int selected_device{-1};
+  bool resume{false}; // Load the renderer checkpoint once initialized
 };
 }  // namespace sparks
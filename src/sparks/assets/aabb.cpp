@@ -2,6 +2,7 @@
 
 #include "algorithm"
 #include "grassland/grassland.h"
+#include "sparks/util/check.h"
 #include <iostream>
 
 #include <glm/gtx/string_cast.hpp>
@@ -43,9 +44,7 @@ bool AxisAlignedBoundingBox::IsIntersect(const glm::vec3 &origin,
       origin.y <= y_high && z_low <= origin.z && origin.z <= z_high) {
     has_intersect = true;
   }
-  if (t_min < 0.0f) {
-    LAND_ERROR("t_min should be set non-negative, but got {}", t_min);
-  }
+  SPARKS_CHECK(t_min >= 0.0f, "t_min should be set non-negative");
   float intersection_range_low = t_max * (1.0f + t_min);
   float intersection_range_high = 0.0f;
   float t;
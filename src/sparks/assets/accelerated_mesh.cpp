@@ -1,6 +1,7 @@
 #include "sparks/assets/accelerated_mesh.h"
 
 #include "algorithm"
+#include "sparks/util/check.h"
 #include <numeric>
 #include <glm/gtx/string_cast.hpp>
 
@@ -10,6 +11,13 @@ namespace sparks {
   BuildAccelerationStructure();
 }
 
+AcceleratedMesh::AcceleratedMesh(const AcceleratedMesh& mesh) :
+  Mesh(mesh), use_accelerate_{ mesh.use_accelerate_ } {
+  if (mesh.bvh_) {
+    bvh_ = std::make_unique<Bvh>(*mesh.bvh_);
+  }
+}
+
 AcceleratedMesh::AcceleratedMesh(const std::vector<Vertex> &vertices,
                                  const std::vector<uint32_t> &indices,
                                  bool use_accelerate)
@@ -17,6 +25,10 @@ AcceleratedMesh::AcceleratedMesh(const std::vector<Vertex> &vertices,
   BuildAccelerationStructure();
 }
 
+std::unique_ptr<Model> AcceleratedMesh::Clone() const {
+  return std::make_unique<AcceleratedMesh>(*this);
+}
+
 float AcceleratedMesh::TraceRay(const glm::vec3 &origin,
                                 const glm::vec3 &direction,
                                 float t_min,
@@ -307,16 +319,7 @@ float AcceleratedMesh::TraceRayLeaf_(const std::vector<int>& face_indices, const
       if (hit_record) {
         auto geometry_normal = glm::normalize(
           glm::cross(v1.position - v0.position, v2.position - v0.position)); // Respect the order
-        if (glm::dot(geometry_normal, v0.normal) < 0) { // opposite direction 
-          LAND_WARN("Opposite direction at v0 {}, v1 {}, v2 {}: geometry {}, normal {}; origin {}, direction {}",
-            glm::to_string(v0.position),
-            glm::to_string(v1.position),
-            glm::to_string(v2.position),
-            glm::to_string(geometry_normal),
-            glm::to_string(v0.normal),
-            glm::to_string(origin),
-            glm::to_string(direction));
-        }
+        SPARKS_CHECK(glm::dot(geometry_normal, v0.normal) >= 0, "Vertex normal opposite to the face");
         // Sometimes the triangle is not represented in standord form (normal outwards), so we discuss two cases
         if (glm::dot(geometry_normal, direction) < 0.0f) {
           hit_record->position = position;
@@ -324,9 +327,7 @@ float AcceleratedMesh::TraceRayLeaf_(const std::vector<int>& face_indices, const
           hit_record->normal = v0.normal * w + v1.normal * u + v2.normal * v;
           //hit_record->tangent =
           //  v0.tangent * w + v1.tangent * u + v2.tangent * v;
-          if (face_idx < 0 || face_idx >= face_tangents_.size()) {
-            LAND_ERROR("Face idx {} out of range [0,{})!", face_idx, face_tangents_.size());
-          }
+          SPARKS_CHECK(face_idx >= 0 && face_idx < face_tangents_.size(), "Face index out of range");
           hit_record->tangent = face_tangents_[face_idx];
           hit_record->tex_coord =
             v0.tex_coord * w + v1.tex_coord * u + v2.tex_coord * v;
@@ -338,9 +339,7 @@ float AcceleratedMesh::TraceRayLeaf_(const std::vector<int>& face_indices, const
           hit_record->normal = -(v0.normal * w + v1.normal * u + v2.normal * v);
           //hit_record->tangent =
           //  -(v0.tangent * w + v1.tangent * u + v2.tangent * v);
-          if (face_idx < 0 || face_idx >= face_tangents_.size()) {
-            LAND_ERROR("Face idx {} out of range [0,{}]!", face_idx, face_tangents_.size() - 1);
-          }
+          SPARKS_CHECK(face_idx >= 0 && face_idx < face_tangents_.size(), "Face index out of range");
           hit_record->tangent = -face_tangents_[face_idx];
           hit_record->tex_coord =
             v0.tex_coord * w + v1.tex_coord * u + v2.tex_coord * v;
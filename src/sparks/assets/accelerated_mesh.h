@@ -20,6 +20,8 @@ class AcceleratedMesh : public Mesh {
     using BvhNode = Bvh::Node;
     //AcceleratedMesh() = default;
     explicit AcceleratedMesh(const Mesh &mesh, bool use_accelerate = true);
+    // Copies the bvh instead of building it again
+    AcceleratedMesh(const AcceleratedMesh &mesh);
     AcceleratedMesh(const std::vector<Vertex> &vertices,
                     const std::vector<uint32_t> &indices,
                     bool use_accelerate = true);
@@ -32,6 +34,7 @@ class AcceleratedMesh : public Mesh {
       float t_min,
       float cur_t_min,
       HitRecord* hit_record) const override;
+    [[nodiscard]] std::unique_ptr<Model> Clone() const override;
     int GetNumFaces();
     void BuildAccelerationStructure(); // build bvh
     Bvh* GetBvh() const {
@@ -39,11 +39,9 @@ void Camera::GenerateRay(float aspect,
                          glm::vec2 range_high,
                          glm::vec3 &origin,
                          glm::vec3 &direction,
-                         std::mt19937& rng) const {
+                         Sampler& sampler) const {
   // sample pixel on image
-  float rand_u = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
-  float rand_v = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
-  auto pos = (range_high - range_low) * glm::vec2{rand_u, rand_v} + range_low;
+  auto pos = (range_high - range_low) * sampler.Get2D() + range_low;
   pos = pos * 2.0f - 1.0f; // convert to rane [-1,1]
   pos.y *= -1.0f;
 
@@ -57,7 +55,7 @@ void Camera::GenerateRay(float aspect,
   //origin =
   //    glm::vec3{glm::vec2{sin_theta, cos_theta} * rand_r * aperture_, 0.0f}; // z-axis of lens is 0 in camera space
 
-  const glm::vec2& disk_point = disk_sample(rng) * aperture_;
+  const glm::vec2& disk_point = disk_sample(sampler) * aperture_;
   origin = glm::vec3{ disk_point, 0.0f };
 
   // Transform the sampled pixel to plane of focus
@@ -67,11 +65,11 @@ void Camera::GenerateRay(float aspect,
       origin);
 }
 
-void Camera::GenerateRay(float aspect, glm::vec2 range_low, glm::vec2 range_high, glm::vec3& origin, glm::vec3& direction, float* t, std::mt19937& rng) const
+void Camera::GenerateRay(float aspect, glm::vec2 range_low, glm::vec2 range_high, glm::vec3& origin, glm::vec3& direction, float* t, Sampler& sampler) const
 {
   // Sample origin and direction
-  GenerateRay(aspect, range_low, range_high, origin, direction, rng);
-  float rand_t = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+  GenerateRay(aspect, range_low, range_high, origin, direction, sampler);
+  float rand_t = sampler.Get1D();
   *t = rand_t * shutter_;
 }
 
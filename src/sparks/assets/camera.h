@@ -1,6 +1,7 @@
 #pragma once
 #include "glm/glm.hpp"
 #include <random>
+#include "sparks/util/sampler.h"
 
 namespace sparks {
 class Camera {
@@ -15,7 +16,7 @@ class Camera {
   * @brief Generate a ray acording to pixel, in camera world. 
   * The true origin and direction should be transformed to world space
   * @param range_low, range_high: The range on the image to sample. Both in [0,1]
-  * @param rng: random number generator
+  * @param sampler: sample values, the pixel position first
   * @param origin: The resulting origin sampled on the lens (in camera space, will be converted to world space later)
   * @param direction: The direction from origin to object
   */
@@ -24,7 +25,7 @@ class Camera {
                    glm::vec2 range_high,
                    glm::vec3 &origin,
                    glm::vec3 &direction,
-                   std::mt19937& rng) const;
+                   Sampler& sampler) const;
   // Also sample the timestep and record in t (for motion blur)
   void GenerateRay(float aspect,
     glm::vec2 range_low,
@@ -32,7 +33,7 @@ class Camera {
     glm::vec3& origin,
     glm::vec3& direction,
     float* t,
-    std::mt19937& rng) const;
+    Sampler& sampler) const;
   bool ImGuiItems();
   void UpdateFov(float delta);
   [[nodiscard]] float GetFov() const {
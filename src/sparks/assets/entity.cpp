@@ -7,6 +7,14 @@ const Model *Entity::GetModel() const {
   return model_.get();
 }
 
+const std::shared_ptr<const Model> &Entity::GetSharedModel() const {
+  return model_;
+}
+
+void Entity::SetModel(std::shared_ptr<const Model> model) {
+  model_ = std::move(model);
+}
+
 glm::mat4 &Entity::GetTransformMatrix() {
   return transform_;
 }
@@ -31,6 +39,27 @@ const Material &Entity::GetMaterial() const {
 return material_;
 }
 
+const PrincipledBsdf &Entity::GetBsdf() const {
+  return bsdf_;
+}
+
+int Entity::GetShadingKernel() const {
+  return shading_kernel_;
+}
+
+void Entity::UpdateBsdf() {
+  bsdf_ = PrincipledBsdf(material_);
+  shading_kernel_ = material_.GetShadingKernel();
+}
+
+int Entity::GetLightIndex() const {
+  return light_index_;
+}
+
+void Entity::SetLightIndex(int light_index) {
+  light_index_ = light_index;
+}
+
 const std::string &Entity::GetName() const {
   return name_;
 }
@@ -3,6 +3,7 @@
 #include "sparks/assets/material.h"
 #include "sparks/assets/mesh.h"
 #include "sparks/assets/model.h"
+#include "sparks/materials/principled_bsdf.h"
 #include "glm/gtx/string_cast.hpp"
 
 namespace sparks {
@@ -62,6 +63,9 @@ class Entity {
   }
 
   [[nodiscard]] const Model *GetModel() const;
+  [[nodiscard]] const std::shared_ptr<const Model> &GetSharedModel() const;
+  // Swap in another model, e.g. a replica of this one on another NUMA node
+  void SetModel(std::shared_ptr<const Model> model);
   [[nodiscard]] glm::mat4 &GetTransformMatrix();
   [[nodiscard]] const glm::mat4 &GetTransformMatrix() const;
   // Consider motion blur
@@ -69,12 +73,22 @@ class Entity {
 
   [[nodiscard]] Material &GetMaterial();
   [[nodiscard]] const Material &GetMaterial() const;
+  // Lobes and shading kernel of the material as of the last UpdateBsdf
+  [[nodiscard]] const PrincipledBsdf &GetBsdf() const;
+  [[nodiscard]] int GetShadingKernel() const;
+  void UpdateBsdf();
+  // Index in Scene::GetLights() of the light this entity emits, -1 if none
+  [[nodiscard]] int GetLightIndex() const;
+  void SetLightIndex(int light_index);
   [[nodiscard]] const std::string &GetName() const;
   [[nodiscard]] const glm::vec3& GetSpeed() const;
 
  private:
-  std::unique_ptr<Model> model_;
+  std::shared_ptr<const Model> model_; // Shared by copies of the scene
   Material material_{};
+  PrincipledBsdf bsdf_{};
+  int shading_kernel_{0};
+  int light_index_{-1};
   glm::mat4 transform_{1.0f};
   std::string name_;
   glm::vec3 speed_{ 0.0f }; // moving speed in world space
@@ -1,5 +1,5 @@
 #include "light.h"
-#include <random>
+#include <algorithm>
 
 namespace sparks {
 float Lights::GetTotalArea() const
@@ -7,10 +7,12 @@ float Lights::GetTotalArea() const
 	return total_area_;
 }
 
-float Lights::Sample(int* light_idx, glm::vec3* pos, std::mt19937& rng) const
+float Lights::Sample(int* light_idx, glm::vec3* pos, Sampler& sampler) const
 {
-	// Sample a light source according to area
-	int idx = std::discrete_distribution<int>(areas_.begin(), areas_.end())(rng);
+	// One uniform picks the slot, its remainder decides between the slot and its alias
+	float u = sampler.Get1D() * float(lights_.size());
+	int slot = std::min(int(u), int(lights_.size()) - 1);
+	int idx = u - float(slot) < alias_prob_[slot] ? slot : alias_[slot];
 	*light_idx = idx;
 
 	const Light* light = &lights_[idx];
@@ -18,8 +20,118 @@ float Lights::Sample(int* light_idx, glm::vec3* pos, std::mt19937& rng) const
 		LAND_ERROR("Geometry is nullptr!");
 		throw "Nullptr geometry!";
 	}
-	*pos = light->geometry->Sample(rng);
-	return 1 / total_area_;
+	*pos = light->geometry->Sample(sampler);
+	return GetPdf(idx);
+}
+
+float Lights::Sample(const glm::vec3& p, const glm::vec3& n, int* light_idx, glm::vec3* pos, Sampler& sampler) const
+{
+	if (sampling_ != LIGHT_SAMPLING_TREE) {
+		return Sample(light_idx, pos, sampler);
+	}
+	float pmf;
+	int idx = tree_.Sample(p, n, sampler.Get1D(), &pmf);
+	if (idx < 0) {
+		return 0.0f;
+	}
+	*light_idx = idx;
+	*pos = lights_[idx].geometry->Sample(sampler);
+	return pmf / areas_[idx];
+}
+
+float Lights::GetPmf(int idx) const
+{
+	return pmf_[idx];
+}
+
+float Lights::GetPdf(int idx) const
+{
+	return pmf_[idx] / areas_[idx];
+}
+
+float Lights::GetPdf(int idx, const glm::vec3& p, const glm::vec3& n) const
+{
+	if (sampling_ != LIGHT_SAMPLING_TREE) {
+		return GetPdf(idx);
+	}
+	return tree_.GetPmf(p, n, idx) / areas_[idx];
+}
+
+void Lights::SetSampling(LightSampling sampling)
+{
+	sampling_ = sampling;
+	Build();
+}
+
+void Lights::Build()
+{
+	BuildAliasTable_();
+	BuildLightTree_();
+}
+
+float Lights::GetPower_(int idx) const
+{
+	const Light& light = lights_[idx];
+	return areas_[idx] * light.emission_strength * (light.emission.x + light.emission.y + light.emission.z) / 3.0f;
+}
+
+void Lights::BuildAliasTable_()
+{
+	int n = int(lights_.size());
+	pmf_.resize(n);
+	float total = 0.0f;
+	for (int i = 0; i < n; i++) {
+		pmf_[i] = sampling_ == LIGHT_SAMPLING_AREA ? areas_[i] : GetPower_(i);
+		total += pmf_[i];
+	}
+	if (total <= 0.0f) { // All lights are dark, fall back to area
+		total = total_area_;
+		pmf_ = areas_;
+	}
+	for (float& pmf : pmf_) {
+		pmf /= total;
+	}
+
+	// Vose's method: pair each slot below the average with one above it
+	alias_prob_.assign(n, 1.0f);
+	alias_.resize(n);
+	std::vector<float> scaled(n);
+	std::vector<int> small, large;
+	for (int i = 0; i < n; i++) {
+		alias_[i] = i;
+		scaled[i] = pmf_[i] * float(n);
+		(scaled[i] < 1.0f ? small : large).push_back(i);
+	}
+	while (!small.empty() && !large.empty()) {
+		int s = small.back();
+		small.pop_back();
+		int l = large.back();
+		alias_prob_[s] = scaled[s];
+		alias_[s] = l;
+		scaled[l] -= 1.0f - scaled[s];
+		if (scaled[l] < 1.0f) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	// What is left is 1 up to rounding, and keeps its own light
+}
+
+void Lights::BuildLightTree_()
+{
+	if (sampling_ != LIGHT_SAMPLING_TREE) {
+		tree_ = LightTree();
+		return;
+	}
+	std::vector<LightBounds> bounds(lights_.size());
+	for (int i = 0; i < int(lights_.size()); i++) {
+		lights_[i].geometry->GetBounds(&bounds[i].low, &bounds[i].high);
+		// Planes do not know which side faces the scene
+		bounds[i].axis = lights_[i].geometry->GetNormal();
+		bounds[i].two_sided = true;
+		bounds[i].power = GetPower_(i);
+	}
+	tree_ = LightTree(bounds);
 }
 
 //void Lights::AddLight(const Light& light)
@@ -34,15 +146,20 @@ float Lights::Sample(int* light_idx, glm::vec3* pos, std::mt19937& rng) const
 //	total_area_ += light.geometry->GetArea();
 //}
 
-void Lights::AddLight(std::unique_ptr<Geometry>&& geometry, const glm::vec3& emission, float emission_strength)
+int Lights::AddLight(std::unique_ptr<Geometry>&& geometry, const glm::vec3& emission, float emission_strength)
 {
 	areas_.emplace_back(geometry->GetArea());
 	total_area_ += geometry->GetArea();
 	lights_.emplace_back(std::move(geometry), emission, emission_strength);
+	return int(lights_.size()) - 1;
 }
 
 const Light* Lights::GetLight(int idx) const {
 	return &(lights_[idx]);
 }
+
+int Lights::GetLightCount() const {
+	return int(lights_.size());
+}
 } // namespace sparks
 
@@ -1,12 +1,20 @@
 #pragma once
+#include "sparks/assets/light_tree.h"
 #include "sparks/geometries/geometry.h"
 #include <memory>
 #include <vector>
 #include "glm/glm.hpp"
 #include <random>
+#include "sparks/util/sampler.h"
 #include "sparks/util/util.h"
 
 namespace sparks {
+	enum LightSampling : int {
+		LIGHT_SAMPLING_AREA = 0,
+		LIGHT_SAMPLING_POWER = 1, // emission x strength x area
+		LIGHT_SAMPLING_TREE = 2 // by estimated contribution to the shading point
+	};
+
 	struct Light {
 		Light():
 			geometry {nullptr},
@@ -29,7 +37,7 @@ namespace sparks {
 		//	emission_strength {light.emission_strength}
 		//{}
 
-		std::unique_ptr<Geometry> geometry;
+		std::shared_ptr<const Geometry> geometry; // Shared by copies of the scene
 		glm::vec3 emission{ 0.0f, 0.0f, 0.0f };
 		float emission_strength{ 0.0f };
 	};
@@ -42,19 +50,45 @@ namespace sparks {
 			areas_ {std::vector<float>()}
 		{}
 		[[nodiscard]] float GetTotalArea() const;
-		/* @brief Sample a light point
+		/* @brief Sample a light point. The light is picked in O(1) from an alias table
 		* @param light_idx: Ptr to index of light
 		* @param pos: Ptr to The sampled light point
-		* @return pdf
+		* @return pdf, with respect to area
 		*/
-		float Sample(int* light_idx, glm::vec3* pos, std::mt19937& rng) const;
+		float Sample(int* light_idx, glm::vec3* pos, Sampler& sampler) const;
+		/* @brief Sample a light point to shade p, of normal n. With LIGHT_SAMPLING_TREE
+		* the light is picked from the light tree, else as above
+		* @return pdf, with respect to area. 0 if no light reaches p
+		*/
+		float Sample(const glm::vec3& p, const glm::vec3& n, int* light_idx, glm::vec3* pos, Sampler& sampler) const;
+		// Probability that Sample picks light idx
+		[[nodiscard]] float GetPmf(int idx) const;
+		// pdf of Sample at a point of light idx, with respect to area
+		[[nodiscard]] float GetPdf(int idx) const;
+		[[nodiscard]] float GetPdf(int idx, const glm::vec3& p, const glm::vec3& n) const;
+		// Pick lights by area, power or the light tree. Rebuilds the alias table and the tree
+		void SetSampling(LightSampling sampling);
+		// Rebuild the alias table and the tree, once the lights are added
+		void Build();
 		//void AddLight(const Light& light);
 		//void AddLight(Light&& light);
-		void AddLight(std::unique_ptr<Geometry> && geometry, const glm::vec3 & emission, float emission_strength);
+		// @return index of the light. Not sampled before the next Build
+		int AddLight(std::unique_ptr<Geometry> && geometry, const glm::vec3 & emission, float emission_strength);
 		const Light* GetLight(int idx) const;
+		[[nodiscard]] int GetLightCount() const;
 	private:
 		std::vector<Light> lights_ ;
 		float total_area_ ;
 		std::vector<float> areas_; // A list of areas
+		LightSampling sampling_{ LIGHT_SAMPLING_AREA };
+		// Alias table (Walker 1977): slot i keeps light i with alias_prob_[i], else picks alias_[i]
+		std::vector<float> pmf_;
+		std::vector<float> alias_prob_;
+		std::vector<int> alias_;
+		LightTree tree_; // Built for LIGHT_SAMPLING_TREE only
+
+		[[nodiscard]] float GetPower_(int idx) const;
+		void BuildAliasTable_();
+		void BuildLightTree_();
 	};
 } // namespace sparks
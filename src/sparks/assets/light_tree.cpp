@@ -0,0 +1,226 @@
+#include "sparks/assets/light_tree.h"
+
+#include "algorithm"
+#include "sparks/util/util.h"
+
+namespace sparks {
+namespace {
+constexpr float kOneMinusEpsilon = 0x1.fffffep-1f;
+
+float SafeSqrt(float x) {
+  return std::sqrt(std::max(x, 0.0f));
+}
+
+// cos(max(0, a - b)), from the sines and cosines of a and b
+float CosSubClamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+  if (cos_a > cos_b) {
+    return 1.0f;
+  }
+  return cos_a * cos_b + sin_a * sin_b;
+}
+
+float SinSubClamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+  if (cos_a > cos_b) {
+    return 0.0f;
+  }
+  return sin_a * cos_b - cos_a * sin_b;
+}
+
+// Rotate v by angle around the unit axis k (Rodrigues)
+glm::vec3 Rotate(const glm::vec3 &v, const glm::vec3 &k, float angle) {
+  float c = std::cos(angle);
+  float s = std::sin(angle);
+  return v * c + glm::cross(k, v) * s + k * glm::dot(k, v) * (1.0f - c);
+}
+}  // namespace
+
+float LightBounds::Importance(const glm::vec3 &p, const glm::vec3 &n) const {
+  glm::vec3 center = (low + high) * 0.5f;
+  glm::vec3 d = p - center;
+  float dist2 = glm::dot(d, d);
+  float radius = glm::length(high - low) * 0.5f;
+  // Keep points near or inside the bounds from getting infinite importance
+  float d2 = std::max(dist2, radius);
+
+  glm::vec3 wi = dist2 > 0.0f ? d / std::sqrt(dist2) : glm::vec3{0.0f};
+  float cos_theta_w = glm::dot(axis, wi);
+  if (two_sided) {
+    cos_theta_w = std::abs(cos_theta_w);
+  }
+  float sin_theta_w = SafeSqrt(1.0f - cos_theta_w * cos_theta_w);
+
+  // Cone of directions from p to the bounding sphere of the bounds
+  float cos_theta_b = -1.0f;
+  if (dist2 > radius * radius) {
+    cos_theta_b = SafeSqrt(1.0f - radius * radius / dist2);
+  }
+  float sin_theta_b = SafeSqrt(1.0f - cos_theta_b * cos_theta_b);
+
+  // Smallest angle between a normal of the cone and a direction to p
+  float sin_theta_o = SafeSqrt(1.0f - cos_theta_o * cos_theta_o);
+  float cos_theta_x = CosSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+  float sin_theta_x = SinSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+  float cos_theta_p = CosSubClamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+  if (cos_theta_p <= 0.0f) { // Area lights emit over a hemisphere
+    return 0.0f;
+  }
+  float importance = power * cos_theta_p / d2;
+
+  if (n != glm::vec3{0.0f}) {
+    float cos_theta_i = std::abs(glm::dot(wi, n));
+    float sin_theta_i = SafeSqrt(1.0f - cos_theta_i * cos_theta_i);
+    importance *= CosSubClamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+  }
+  return std::max(importance, 0.0f);
+}
+
+LightBounds Union(const LightBounds &a, const LightBounds &b) {
+  if (a.power == 0.0f) {
+    return b;
+  }
+  if (b.power == 0.0f) {
+    return a;
+  }
+  LightBounds bounds;
+  bounds.low = glm::min(a.low, b.low);
+  bounds.high = glm::max(a.high, b.high);
+  bounds.power = a.power + b.power;
+  bounds.two_sided = a.two_sided || b.two_sided;
+
+  // Smallest cone holding both normal cones
+  float theta_a = std::acos(clamp(a.cos_theta_o, -1.0f, 1.0f));
+  float theta_b = std::acos(clamp(b.cos_theta_o, -1.0f, 1.0f));
+  float theta_d = std::acos(clamp(glm::dot(a.axis, b.axis), -1.0f, 1.0f));
+  if (std::min(theta_d + theta_b, PI) <= theta_a) {
+    bounds.axis = a.axis;
+    bounds.cos_theta_o = a.cos_theta_o;
+    return bounds;
+  }
+  if (std::min(theta_d + theta_a, PI) <= theta_b) {
+    bounds.axis = b.axis;
+    bounds.cos_theta_o = b.cos_theta_o;
+    return bounds;
+  }
+  float theta_o = (theta_a + theta_d + theta_b) * 0.5f;
+  glm::vec3 rotation_axis = glm::cross(a.axis, b.axis);
+  if (theta_o >= PI || glm::dot(rotation_axis, rotation_axis) == 0.0f) {
+    bounds.axis = a.axis;
+    bounds.cos_theta_o = -1.0f; // All directions
+    return bounds;
+  }
+  bounds.axis = Rotate(a.axis, glm::normalize(rotation_axis), theta_o - theta_a);
+  bounds.cos_theta_o = std::cos(theta_o);
+  return bounds;
+}
+
+LightTree::LightTree(const std::vector<LightBounds> &lights) {
+  if (lights.empty()) {
+    return;
+  }
+  std::vector<int> order(lights.size());
+  for (int i = 0; i < int(lights.size()); i++) {
+    order[i] = i;
+  }
+  nodes_.reserve(2 * lights.size() - 1);
+  light_trails_.resize(lights.size());
+  Build_(lights, order, 0, int(lights.size()), 0, 0);
+}
+
+int LightTree::Build_(const std::vector<LightBounds> &lights,
+                      std::vector<int> &order,
+                      int begin,
+                      int end,
+                      uint64_t trail,
+                      int depth) {
+  int node = int(nodes_.size());
+  nodes_.emplace_back();
+  if (end - begin == 1) {
+    nodes_[node].bounds = lights[order[begin]];
+    nodes_[node].index = order[begin];
+    light_trails_[order[begin]] = trail;
+    return node;
+  }
+
+  // Median split of the centroids along their longest axis. Depth stays
+  // below 64, which the trails need
+  glm::vec3 low{1e30f};
+  glm::vec3 high{-1e30f};
+  for (int i = begin; i < end; i++) {
+    glm::vec3 centroid = (lights[order[i]].low + lights[order[i]].high) * 0.5f;
+    low = glm::min(low, centroid);
+    high = glm::max(high, centroid);
+  }
+  glm::vec3 extent = high - low;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+  int mid = (begin + end) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                   [&](int a, int b) {
+                     return lights[a].low[axis] + lights[a].high[axis] <
+                            lights[b].low[axis] + lights[b].high[axis];
+                   });
+
+  Build_(lights, order, begin, mid, trail, depth + 1);
+  int second = Build_(lights, order, mid, end, trail | (uint64_t(1) << depth), depth + 1);
+  nodes_[node].bounds = Union(nodes_[node + 1].bounds, nodes_[second].bounds);
+  nodes_[node].index = second;
+  nodes_[node].is_leaf = false;
+  return node;
+}
+
+int LightTree::Sample(const glm::vec3 &p, const glm::vec3 &n, float u, float *pmf) const {
+  *pmf = 0.0f;
+  if (nodes_.empty() || nodes_[0].bounds.Importance(p, n) == 0.0f) {
+    return -1;
+  }
+  float node_pmf = 1.0f;
+  int node = 0;
+  while (!nodes_[node].is_leaf) {
+    float importance_first = nodes_[node + 1].bounds.Importance(p, n);
+    float importance_second = nodes_[nodes_[node].index].bounds.Importance(p, n);
+    if (importance_first + importance_second == 0.0f) {
+      return -1;
+    }
+    float prob_first = importance_first / (importance_first + importance_second);
+    // Reuse u for the levels below, rescaled to [0, 1)
+    if (u < prob_first) {
+      u = std::min(u / prob_first, kOneMinusEpsilon);
+      node_pmf *= prob_first;
+      node = node + 1;
+    }
+    else {
+      u = std::min((u - prob_first) / (1.0f - prob_first), kOneMinusEpsilon);
+      // Same expression as GetPmf, so both give the same pmf to the bit
+      node_pmf *= importance_second / (importance_first + importance_second);
+      node = nodes_[node].index;
+    }
+  }
+  *pmf = node_pmf;
+  return nodes_[node].index;
+}
+
+float LightTree::GetPmf(const glm::vec3 &p, const glm::vec3 &n, int light) const {
+  if (nodes_.empty() || nodes_[0].bounds.Importance(p, n) == 0.0f) {
+    return 0.0f;
+  }
+  float pmf = 1.0f;
+  uint64_t trail = light_trails_[light];
+  int node = 0;
+  while (!nodes_[node].is_leaf) {
+    float importance_first = nodes_[node + 1].bounds.Importance(p, n);
+    float importance_second = nodes_[nodes_[node].index].bounds.Importance(p, n);
+    if (importance_first + importance_second == 0.0f) {
+      return 0.0f;
+    }
+    if (trail & 1u) {
+      pmf *= importance_second / (importance_first + importance_second);
+      node = nodes_[node].index;
+    }
+    else {
+      pmf *= importance_first / (importance_first + importance_second);
+      node = node + 1;
+    }
+    trail >>= 1;
+  }
+  return pmf;
+}
+}  // namespace sparks
@@ -0,0 +1,59 @@
+#pragma once
+#include "cstdint"
+#include "glm/glm.hpp"
+#include "vector"
+
+namespace sparks {
+/* @brief Bounds of a set of lights: where they are, how much they emit and
+* the cone holding their normals (Conty Estevez and Kulla 2018).
+*/
+struct LightBounds {
+  glm::vec3 low{0.0f};
+  glm::vec3 high{0.0f};
+  glm::vec3 axis{0.0f, 0.0f, 1.0f}; // of the normal cone
+  float cos_theta_o{1.0f};          // cosine of the spread of the normals around axis
+  float power{0.0f};
+  bool two_sided{false};
+
+  /* @brief Conservative estimate of the light received at p, as pbrt-v4 does.
+  * @param n, normal at p. Zero for no cosine at the receiver
+  */
+  [[nodiscard]] float Importance(const glm::vec3 &p, const glm::vec3 &n) const;
+};
+
+LightBounds Union(const LightBounds &a, const LightBounds &b);
+
+/* @brief Binary tree over the lights of a scene. A light is picked for a
+* shading point by descending the tree, choosing each child in proportion to
+* its importance, so near lights facing the point are picked more often.
+*/
+class LightTree {
+ public:
+  LightTree() = default;
+  explicit LightTree(const std::vector<LightBounds> &lights);
+
+  /* @param u, uniform in [0, 1)
+  * @return index of the light, -1 if no light reaches p
+  */
+  int Sample(const glm::vec3 &p, const glm::vec3 &n, float u, float *pmf) const;
+  // Probability that Sample picks light at p
+  [[nodiscard]] float GetPmf(const glm::vec3 &p, const glm::vec3 &n, int light) const;
+
+ private:
+  struct Node {
+    LightBounds bounds;
+    int index{0}; // Of the light for a leaf, else of the second child. The first child follows the node
+    bool is_leaf{true};
+  };
+  std::vector<Node> nodes_;
+  // Per light, bit i is set if the path from the root takes the second child at depth i
+  std::vector<uint64_t> light_trails_;
+
+  int Build_(const std::vector<LightBounds> &lights,
+             std::vector<int> &order,
+             int begin,
+             int end,
+             uint64_t trail,
+             int depth);
+};
+}  // namespace sparks
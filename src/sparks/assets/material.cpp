@@ -130,6 +130,11 @@ Material::Material(const glm::vec3 &albedo) : Material() {
   albedo_color = albedo;
 }
 
+int Material::GetShadingKernel() const {
+  bool normal_map = normal_texture_id != 1; // 1 is the flat default
+  return int(material_type) * 2 + int(normal_map);
+}
+
 //float Material::GetBsdf(
 //    const glm::vec3& pos,
 //    const glm::vec3& ray_in,
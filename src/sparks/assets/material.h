@@ -12,6 +12,9 @@ enum MaterialType : int {
   MATERIAL_TYPE_PRINCIPLED = 3,
   MATERIAL_TYPE_EMISSION = 4
 };
+constexpr int kNumMaterialTypes = MATERIAL_TYPE_EMISSION + 1;
+// Per material type, with and without a normal map
+constexpr int kNumShadingKernels = 2 * kNumMaterialTypes;
 
 class Scene;
 
@@ -43,6 +46,9 @@ public:
   explicit Material(const glm::vec3 &albedo);
   Material(Scene *scene, const tinyxml2::XMLElement *material_element);
 
+  // Index of the shading kernel specialized for the features this material uses
+  [[nodiscard]] int GetShadingKernel() const;
+
   //// Return bsdf given ray_in and ray_out
   //glm::vec3 GetBsdf(
   //  const HitRecord& hit_record,
@@ -380,7 +380,11 @@ void Mesh::MergeVertices() {
   indices_ = indices;
 }
 
-const char *Mesh::GetDefaultEntityName() {
+std::unique_ptr<Model> Mesh::Clone() const {
+  return std::make_unique<Mesh>(*this);
+}
+
+const char *Mesh::GetDefaultEntityName() const {
   return "Mesh";
 }
 
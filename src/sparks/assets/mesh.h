@@ -29,11 +29,12 @@ class Mesh : public Model {
     float t_min,
     float cur_t_min,
     HitRecord* hit_record) const override;
-  const char *GetDefaultEntityName() override;
+  const char *GetDefaultEntityName() const override;
   [[nodiscard]] AxisAlignedBoundingBox GetAABB(
       const glm::mat4 &transform) const override;
   [[nodiscard]] std::vector<Vertex> GetVertices() const override;
   [[nodiscard]] std::vector<uint32_t> GetIndices() const override;
+  [[nodiscard]] std::unique_ptr<Model> Clone() const override;
   static Mesh Cube(const glm::vec3 &center, const glm::vec3 &size);
   static Mesh Sphere(const glm::vec3 &center = glm::vec3{0.0f},
                      float radius = 1.0f,
@@ -1,7 +1,7 @@
 #include "sparks/assets/model.h"
 
 namespace sparks {
-const char *Model::GetDefaultEntityName() {
+const char *Model::GetDefaultEntityName() const {
   return "Unknown Model";
 }
 }  // namespace sparks
@@ -1,6 +1,7 @@
 #pragma once
 #include "glm/glm.hpp"
 #include "iostream"
+#include "memory"
 #include "sparks/assets/aabb.h"
 #include "sparks/assets/hit_record.h"
 #include "sparks/assets/vertex.h"
@@ -27,6 +28,8 @@ class Model {
       const glm::mat4 &transform) const = 0;
   [[nodiscard]] virtual std::vector<Vertex> GetVertices() const = 0;
   [[nodiscard]] virtual std::vector<uint32_t> GetIndices() const = 0;
-  virtual const char *GetDefaultEntityName();
+  // Deep copy, its memory allocated and first touched by the calling thread
+  [[nodiscard]] virtual std::unique_ptr<Model> Clone() const = 0;
+  virtual const char *GetDefaultEntityName() const;
 };
 }  // namespace sparks
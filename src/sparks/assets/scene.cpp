@@ -6,6 +6,7 @@
 #include "sparks/assets/accelerated_mesh.h"
 #include "sparks/util/util.h"
 #include "sparks/geometries/plane.h"
+#include <algorithm>
 #include <memory>
 #include <numeric>
 #include <glm/gtx/string_cast.hpp>
@@ -127,6 +128,12 @@ const glm::vec3 &Scene::GetCameraPitchYawRoll() const {
   return camera_pitch_yaw_roll_;
 }
 
+void Scene::UpdateBsdfs() {
+  for (auto &entity : entities_) {
+    entity.UpdateBsdf();
+  }
+}
+
 void Scene::UpdateEnvmapConfiguration() {
   const auto &scene = *this;
   auto envmap_id = scene.GetEnvmapId();
@@ -135,7 +142,8 @@ void Scene::UpdateEnvmapConfiguration() {
 
   envmap_minor_color_ = glm::vec3{0.0f};
   envmap_major_color_ = glm::vec3{0.0f};
-  envmap_cdf_.resize(envmap_texture.GetWidth() * envmap_texture.GetHeight());
+  std::vector<float> envmap_cdf(envmap_texture.GetWidth() *
+                                envmap_texture.GetHeight());
 
   std::vector<float> sample_scale_(envmap_texture.GetHeight() + 1);
   auto inv_width = 1.0f / float(envmap_texture.GetWidth());
@@ -176,14 +184,71 @@ void Scene::UpdateEnvmapConfiguration() {
       }
 
       total_weight += strength * scale;
-      envmap_cdf_[i] = total_weight;
+      envmap_cdf[i] = total_weight;
     }
   }
 
   auto inv_total_weight = 1.0f / total_weight;
-  for (auto &v : envmap_cdf_) {
+  for (auto &v : envmap_cdf) {
     v *= inv_total_weight;
   }
+  envmap_cdf_ = std::make_shared<const std::vector<float>>(std::move(envmap_cdf));
+
+  // The texture is filtered, so a texel may show light from its neighbours.
+  // Weigh each texel by the brightest of them, so every lit direction can be sampled
+  int width = int(envmap_texture.GetWidth());
+  int height = int(envmap_texture.GetHeight());
+  std::vector<float> luminance(width * height);
+  for (int i = 0; i < width * height; i++) {
+    luminance[i] = glm::dot(glm::vec3{buffer[i]}, glm::vec3{0.2126f, 0.7152f, 0.0722f});
+  }
+  std::vector<float> weights(width * height);
+  for (int y = 0; y < height; y++) {
+    float sin_theta = std::sin((float(y) + 0.5f) * inv_height * glm::pi<float>());
+    for (int x = 0; x < width; x++) {
+      float max_luminance = 0.0f;
+      for (int dy = -1; dy <= 1; dy++) {
+        int ny = std::clamp(y + dy, 0, height - 1);
+        for (int dx = -1; dx <= 1; dx++) {
+          int nx = (x + dx + width) % width;
+          max_luminance = std::max(max_luminance, luminance[ny * width + nx]);
+        }
+      }
+      weights[y * width + x] = max_luminance * sin_theta;
+    }
+  }
+  envmap_distribution_ = std::make_shared<const PiecewiseConstant2D>(weights.data(), width, height);
+}
+
+bool Scene::HasEnvmapLight() const {
+  return envmap_distribution_->GetIntegral() > 0.0f;
+}
+
+glm::vec3 Scene::SampleEnvmapLight(glm::vec2 u, glm::vec3 *direction, float *pdf) const {
+  float pdf_uv;
+  glm::vec2 uv = envmap_distribution_->Sample(u, &pdf_uv);
+  // Inverse of the mapping in SampleEnvmap
+  float theta = uv.y * PI;
+  float phi = uv.x * 2.0f * PI - envmap_offset_;
+  float sin_theta = std::sin(theta);
+  if (pdf_uv == 0.0f || sin_theta == 0.0f) {
+    *pdf = 0.0f;
+    return glm::vec3{0.0f};
+  }
+  *direction = {sin_theta * std::sin(phi), std::cos(theta), -sin_theta * std::cos(phi)};
+  *pdf = pdf_uv / (2.0f * PI * PI * sin_theta);
+  return glm::vec3{SampleEnvmap(*direction)};
+}
+
+float Scene::GetEnvmapLightPdf(const glm::vec3 &direction) const {
+  float cos_theta = glm::clamp(direction.y, -1.0f, 1.0f);
+  float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+  if (sin_theta == 0.0f) {
+    return 0.0f;
+  }
+  float u = (envmap_offset_ + glm::atan(direction.x, -direction.z)) * INV_PI * 0.5f;
+  glm::vec2 uv{u - std::floor(u), std::acos(cos_theta) * INV_PI};
+  return envmap_distribution_->GetPdf(uv) / (2.0f * PI * PI * sin_theta);
 }
 
 // Return a fixed light direction in the scene
@@ -205,7 +270,7 @@ const glm::vec3 &Scene::GetEnvmapMajorColor() const {
   return envmap_major_color_;
 }
 const std::vector<float> &Scene::GetEnvmapCdf() const {
-  return envmap_cdf_;
+  return *envmap_cdf_;
 }
 
 float Scene::TraceRay(const glm::vec3 &origin,
@@ -477,6 +542,7 @@ Scene::Scene(const std::string& filename) : Scene() {
 
       auto grandchild_element = child_element->FirstChildElement("material");
       if (grandchild_element) {
+        int light_index = -1;
         material = Material(this, grandchild_element);
         std::string material_type{ grandchild_element->FindAttribute("type")->Value() };
         if (material_type == "emission") { // Also add to lights
@@ -486,7 +552,7 @@ Scene::Scene(const std::string& filename) : Scene() {
             if (geometry_type == "plane") {
               auto geometry = std::make_unique<Plane>(geometry_element);
               //LAND_INFO("Add plane light with area {}", geometry->GetArea());
-              lights_.AddLight(
+              light_index = lights_.AddLight(
                 std::move(geometry),
                 material.emission,
                 material.emission_strength);
@@ -504,23 +570,26 @@ Scene::Scene(const std::string& filename) : Scene() {
         glm::mat4 transformation = XmlComposeTransformMatrix(child_element);
 
         auto name_attribute = child_element->FindAttribute("name");
+        int entity_id;
         if (name_attribute) {
-          AddEntity(
+          entity_id = AddEntity(
             std::move(std::make_unique<AcceleratedMesh>(mesh)), material, transformation,
             std::string(name_attribute->Value()),
             speed);
           //LAND_INFO("Added entity {}", std::string(name_attribute->Value()));
         }
         else {
-          AddEntity(
+          entity_id = AddEntity(
             std::move(std::make_unique<AcceleratedMesh>(mesh)), material, transformation, speed);
         }
+        entities_[entity_id].SetLightIndex(light_index);
       }
       else {
         LAND_ERROR("Unknown Element Type: {}", child_element->Value());
       }
     }
   }
+  lights_.Build(); // Once for all the lights of the file
   SetCameraToWorld(camera_to_world);
   UpdateEnvmapConfiguration();
 }
@@ -7,6 +7,7 @@
 #include "sparks/assets/texture.h"
 #include "sparks/assets/util.h"
 #include "sparks/assets/light.h"
+#include "sparks/util/piecewise_constant.h"
 #include "vector"
 
 namespace sparks {
@@ -63,6 +64,8 @@ class Scene {
 
   // Update envmap_light_direction_, envmap_minor_color_, envmap_major_color_
   void UpdateEnvmapConfiguration();
+  // Rebuild the BSDF lobes of every entity from its material
+  void UpdateBsdfs();
 
   [[nodiscard]] glm::vec3 GetEnvmapLightDirection() const;
   [[nodiscard]] const glm::vec3 &GetEnvmapMinorColor() const;
@@ -70,6 +73,15 @@ class Scene {
   [[nodiscard]] const std::vector<float> &GetEnvmapCdf() const;
   ;
   [[nodiscard]] glm::vec4 SampleEnvmap(const glm::vec3 &direction) const;
+  // Whether the envmap emits any light, so it can be sampled as a light
+  [[nodiscard]] bool HasEnvmapLight() const;
+  /* @brief Sample a direction toward the envmap in proportion to its luminance
+  * @param u, uniform in [0, 1)^2
+  * @return radiance from *direction. *pdf with respect to solid angle
+  */
+  glm::vec3 SampleEnvmapLight(glm::vec2 u, glm::vec3 *direction, float *pdf) const;
+  // pdf of SampleEnvmapLight, with respect to solid angle
+  [[nodiscard]] float GetEnvmapLightPdf(const glm::vec3 &direction) const;
 
   /*@return t: The distance of intersection ?
   * @param direction: Should be normalized.
@@ -118,7 +130,12 @@ class Scene {
 
   int envmap_id_{1}; // texture id
   float envmap_offset_{0.0f}; // Fixed, no method to change it?
-  std::vector<float> envmap_cdf_;
+  // Rebuilt, not modified, so copies of the scene can share it
+  std::shared_ptr<const std::vector<float>> envmap_cdf_{
+      std::make_shared<const std::vector<float>>()};
+  // Luminance times sin(theta) of the envmap texels, for SampleEnvmapLight
+  std::shared_ptr<const PiecewiseConstant2D> envmap_distribution_{
+      std::make_shared<const PiecewiseConstant2D>()};
   glm::vec3 envmap_light_direction_{0.0f, 1.0f, 0.0f};
   glm::vec3 envmap_major_color_{0.5f};
   glm::vec3 envmap_minor_color_{0.3f};
@@ -13,9 +13,8 @@ Texture::Texture(uint32_t width,
                  SampleType sample_type) {
   width_ = width;
   height_ = height;
-  buffer_.resize(width * height);
+  buffer_ = std::make_shared<std::vector<glm::vec4>>(width * height, color);
   sample_type_ = sample_type;
-  std::fill(buffer_.data(), buffer_.data() + width * height, color);
 }
 
 Texture::Texture(uint32_t width,
@@ -24,21 +23,26 @@ Texture::Texture(uint32_t width,
                  SampleType sample_type) {
   width_ = width;
   height_ = height;
-  buffer_.resize(width * height);
+  buffer_ = std::make_shared<std::vector<glm::vec4>>(
+      color_buffer, color_buffer + width * height);
   sample_type_ = sample_type;
-  std::memcpy(buffer_.data(), color_buffer,
-              sizeof(glm::vec4) * width_ * height_);
 }
 
 void Texture::Resize(uint32_t width, uint32_t height) {
   std::vector<glm::vec4> new_buffer(width * height);
   for (int i = 0; i < std::min(height, height_); i++) {
-    std::memcpy(new_buffer.data() + width * i, buffer_.data() + width_ * i,
+    std::memcpy(new_buffer.data() + width * i, buffer_->data() + width_ * i,
                 sizeof(glm::vec4) * std::min(width, width_));
   }
   width_ = width;
   height_ = height;
-  buffer_ = new_buffer;
+  buffer_ = std::make_shared<std::vector<glm::vec4>>(std::move(new_buffer));
+}
+
+void Texture::Detach_() {
+  if (buffer_.use_count() > 1) {
+    buffer_ = std::make_shared<std::vector<glm::vec4>>(*buffer_);
+  }
 }
 
 bool Texture::Load(const std::string &file_path, Texture &texture) {
@@ -74,17 +78,17 @@ bool Texture::Load(const std::string &file_path, Texture &texture) {
 void Texture::Store(const std::string &file_path) {
   if (absl::EndsWithIgnoreCase(file_path, ".hdr")) {
     stbi_write_hdr(file_path.c_str(), width_, height_, 4,
-                   reinterpret_cast<float *>(buffer_.data()));
+                   reinterpret_cast<const float *>(buffer_->data()));
   } else {
     std::vector<uint8_t> convert_buffer(width_ * height_ * 4);
     auto float_to_uint8 = [](float x) {
       return std::min(std::max(std::lround(x * 255.0f), 0l), 255l);
     };
     for (int i = 0; i < width_ * height_; i++) {
-      convert_buffer[i * 4] = float_to_uint8(buffer_[i].x);
-      convert_buffer[i * 4 + 1] = float_to_uint8(buffer_[i].y);
-      convert_buffer[i * 4 + 2] = float_to_uint8(buffer_[i].z);
-      convert_buffer[i * 4 + 3] = float_to_uint8(buffer_[i].w);
+      convert_buffer[i * 4] = float_to_uint8((*buffer_)[i].x);
+      convert_buffer[i * 4 + 1] = float_to_uint8((*buffer_)[i].y);
+      convert_buffer[i * 4 + 2] = float_to_uint8((*buffer_)[i].z);
+      convert_buffer[i * 4 + 3] = float_to_uint8((*buffer_)[i].w);
     }
     if (absl::EndsWithIgnoreCase(file_path, ".png")) {
       stbi_write_png(file_path.c_str(), width_, height_, 4,
@@ -111,15 +115,16 @@ SampleType Texture::GetSampleType() const {
 }
 
 glm::vec4 &Texture::operator()(int x, int y) {
+  Detach_();
   x = std::min(int(width_ - 1), std::max(x, 0));
   y = std::min(int(height_ - 1), std::max(y, 0));
-  return buffer_[y * width_ + x];
+  return (*buffer_)[y * width_ + x];
 }
 
 const glm::vec4 &Texture::operator()(int x, int y) const {
   x = std::min(int(width_ - 1), std::max(x, 0));
   y = std::min(int(height_ - 1), std::max(y, 0));
-  return buffer_[y * width_ + x];
+  return (*buffer_)[y * width_ + x];
 }
 
 glm::vec4 Texture::Sample(glm::vec2 tex_coord) const {
@@ -148,11 +153,12 @@ uint32_t Texture::GetHeight() const {
 }
 
 glm::vec4 *Texture::GetBuffer() {
-  return buffer_.data();
+  Detach_();
+  return buffer_->data();
 }
 
 const glm::vec4 *Texture::GetBuffer() const {
-  return buffer_.data();
+  return buffer_->data();
 }
 
 }  // namespace sparks
@@ -1,5 +1,6 @@
 #pragma once
 #include "glm/glm.hpp"
+#include "memory"
 #include "string"
 #include "vector"
 
@@ -33,7 +34,11 @@ class Texture {
  private:
   uint32_t width_{};
   uint32_t height_{};
-  std::vector<glm::vec4> buffer_;
+  // Shared between copies of the texture until one of them is written
+  std::shared_ptr<std::vector<glm::vec4>> buffer_;
   SampleType sample_type_{SAMPLE_TYPE_LINEAR};
+
+  // Give this texture its own copy of a shared buffer before writing to it
+  void Detach_();
 };
 }  // namespace sparks
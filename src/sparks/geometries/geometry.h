@@ -1,6 +1,7 @@
 #pragma once
 #include "glm/glm.hpp"
 #include <random>
+#include "sparks/util/sampler.h"
 
 namespace sparks {
 // Parent class of Common geometries. Used for Light source
@@ -10,6 +11,11 @@ class Geometry {
   [[nodiscard]] virtual float GetArea() const = 0; // pure virtual
 
   // Sample a point on the light source
-  [[nodiscard]] virtual glm::vec3 Sample(std::mt19937& rng) const = 0; // pure virtual
+  [[nodiscard]] virtual glm::vec3 Sample(Sampler& sampler) const = 0; // pure virtual
+
+  // Axis aligned bounds of the light source
+  virtual void GetBounds(glm::vec3* low, glm::vec3* high) const = 0;
+  // Normal of a flat light source. Either side may emit
+  [[nodiscard]] virtual glm::vec3 GetNormal() const = 0;
 };
 } // namespace sparks
\ No newline at end of file
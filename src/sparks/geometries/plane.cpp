@@ -51,26 +51,36 @@ float sparks::Plane::GetArea() const
     return area_;
 }
 
-glm::vec3 sparks::Plane::Sample(std::mt19937& rng) const
+glm::vec3 sparks::Plane::Sample(Sampler& sampler) const
 {
-    float pos_x, pos_y, pos_z;
+    // One 2D sample over the two non-degenerate axes, so both dimensions
+    // come from the same stratum
+    glm::vec2 u = sampler.Get2D();
     if (x_min_ == x_max_) {
-        pos_x = x_min_;
-    }
-    else {
-        pos_x = std::uniform_real_distribution<float>(x_min_, x_max_)(rng);
+        return glm::vec3{x_min_, y_min_ + u.x * (y_max_ - y_min_),
+                         z_min_ + u.y * (z_max_ - z_min_)};
     }
     if (y_min_ == y_max_) {
-        pos_y = y_min_;
-    }
-    else {
-        pos_y = std::uniform_real_distribution<float>(y_min_, y_max_)(rng);
+        return glm::vec3{x_min_ + u.x * (x_max_ - x_min_), y_min_,
+                         z_min_ + u.y * (z_max_ - z_min_)};
     }
-    if (z_min_ == z_max_) {
-        pos_z = z_min_;
+    return glm::vec3{x_min_ + u.x * (x_max_ - x_min_),
+                     y_min_ + u.y * (y_max_ - y_min_), z_min_};
+}
+
+void sparks::Plane::GetBounds(glm::vec3* low, glm::vec3* high) const
+{
+    *low = glm::vec3{x_min_, y_min_, z_min_};
+    *high = glm::vec3{x_max_, y_max_, z_max_};
+}
+
+glm::vec3 sparks::Plane::GetNormal() const
+{
+    if (x_min_ == x_max_) {
+        return glm::vec3{1.0f, 0.0f, 0.0f};
     }
-    else {
-        pos_z = std::uniform_real_distribution<float>(z_min_, z_max_)(rng);
+    if (y_min_ == y_max_) {
+        return glm::vec3{0.0f, 1.0f, 0.0f};
     }
-    return glm::vec3{pos_x, pos_y, pos_z};
+    return glm::vec3{0.0f, 0.0f, 1.0f};
 }
@@ -11,7 +11,10 @@ public:
 	[[nodiscard]] float GetArea() const;
 	
 	// Only two seeds will be used
-	[[nodiscard]] glm::vec3 Sample(std::mt19937& rng) const;
+	[[nodiscard]] glm::vec3 Sample(Sampler& sampler) const;
+	void GetBounds(glm::vec3* low, glm::vec3* high) const;
+	// The axis of the degenerate dim
+	[[nodiscard]] glm::vec3 GetNormal() const;
 private:
 	// Define a rectangle (On one dim, min == max)
 	float x_min_, x_max_, y_min_, y_max_, z_min_, z_max_;
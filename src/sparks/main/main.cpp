@@ -1,9 +1,14 @@
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
+#include "absl/strings/match.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include "iostream"
+#include "sparks/renderer/distributed.h"
+#include "sparks/renderer/shared_framebuffer.h"
 #include "sparks/sparks.h"
+#include "sparks/util/check.h"
+#include "sparks/util/log.h"
 #include "tiny_obj_loader.h"
 #include <exception>
 
@@ -28,13 +33,45 @@ ABSL_FLAG(bool, vkrt, false, "Use Vulkan Ray Tracing pipeline");
 ABSL_FLAG(int, device, -1, "Select physical device manually");
 
 ABSL_FLAG(bool, test, false, "True if testing");
+ABSL_FLAG(bool, numa, false, "Pin one worker group per NUMA node");
+ABSL_FLAG(bool, numa_stats, false, "Log per NUMA node throughput");
+ABSL_FLAG(float, time_budget, 0.0f, "Stop rendering after these seconds, 0 for unlimited");
+ABSL_FLAG(bool, adaptive_tiles, true, "Split tiles by measured render time");
+ABSL_FLAG(int, tile_size, 0, "Initial tile size in pixels, 0 for auto");
+ABSL_FLAG(std::string, tile_order, "hilbert", "Tile order: hilbert, morton, random or cost");
+ABSL_FLAG(bool, wavefront, false, "Trace each tile breadth-first, sorted by material");
+ABSL_FLAG(std::string, integrator, "path", "Integrator: path, bdpt or ppm");
+ABSL_FLAG(int, photons_per_pass, 1 << 18, "Photons traced each pass by ppm");
+ABSL_FLAG(float, photon_radius, 0.05f, "Gather radius of the first ppm pass");
+ABSL_FLAG(std::string, sampler, "sobol", "Sampler: independent, sobol or halton");
+ABSL_FLAG(bool, blue_noise, false, "Decorrelate pixels by blue noise, error looks like fine grain");
+ABSL_FLAG(std::string, light_sampling, "tree", "Pick lights by area, power or from the light tree");
+ABSL_FLAG(std::string, checkpoint, "", "Checkpoint file of the accumulation");
+ABSL_FLAG(float, checkpoint_interval, 600.0f, "Seconds between checkpoints, 0 to disable");
+ABSL_FLAG(bool, resume, false, "Continue the accumulation stored in the checkpoint file");
+
+ABSL_FLAG(bool, headless, false, "Render without a window and write --output");
+ABSL_FLAG(std::string, scene, "", "Scene file to render in headless mode");
+ABSL_FLAG(uint32_t, spp, 64, "Samples per pixel to render in headless mode");
+ABSL_FLAG(std::string, output, "output.hdr", "Image written in headless mode");
+ABSL_FLAG(std::string, reference, "", "Headless: .hdr image to report the RMSE against");
+ABSL_FLAG(int, coordinator_port, 0, "Headless: merge the samples of workers on this port");
+ABSL_FLAG(uint32_t, num_workers, 1, "Headless: number of workers the coordinator waits for");
+ABSL_FLAG(std::string, connect, "", "Headless: render as a worker of coordinator host:port");
+ABSL_FLAG(float, stream_interval, 2.0f, "Seconds between accumulation buffers streamed to the coordinator");
+ABSL_FLAG(std::string, shm_name, "", "Headless: publish the accumulation to this shared memory object");
+ABSL_FLAG(bool, shm_unlink, false, "Headless: remove the shared memory object when the render ends");
 
 void RunApp(sparks::Renderer *renderer);
 
+void RunHeadless(sparks::Renderer *renderer);
+
 void test_main(); 
 
 int main(int argc, char *argv[]) {
     try {
+      absl::SetProgramUsageMessage("Usage");
+      absl::ParseCommandLine(argc, argv);
       LAND_INFO("width {}, height {}, vkrt {}, test {}", 
         absl::GetFlag(FLAGS_width),
         absl::GetFlag(FLAGS_height),
@@ -42,11 +79,61 @@ int main(int argc, char *argv[]) {
         absl::GetFlag(FLAGS_test));
       bool is_test = absl::GetFlag(FLAGS_test);
       if (!is_test) {
-        absl::SetProgramUsageMessage("Usage");
-        absl::ParseCommandLine(argc, argv);
         sparks::RendererSettings renderer_settings; // Default renderer setting
+        renderer_settings.numa_aware = absl::GetFlag(FLAGS_numa);
+        renderer_settings.numa_stats = absl::GetFlag(FLAGS_numa_stats);
+        renderer_settings.time_budget = absl::GetFlag(FLAGS_time_budget);
+        renderer_settings.adaptive_tiles = absl::GetFlag(FLAGS_adaptive_tiles);
+        renderer_settings.tile_size = absl::GetFlag(FLAGS_tile_size);
+        std::string tile_order = absl::GetFlag(FLAGS_tile_order);
+        if (tile_order == "morton") {
+          renderer_settings.tile_order = sparks::TILE_ORDER_MORTON;
+        } else if (tile_order == "random") {
+          renderer_settings.tile_order = sparks::TILE_ORDER_RANDOM;
+        } else if (tile_order == "cost") {
+          renderer_settings.tile_order = sparks::TILE_ORDER_COST;
+        } else if (tile_order != "hilbert") {
+          LAND_WARN("Unknown tile order {}, using hilbert", tile_order);
+        }
+        renderer_settings.wavefront = absl::GetFlag(FLAGS_wavefront);
+        std::string integrator = absl::GetFlag(FLAGS_integrator);
+        if (integrator == "bdpt") {
+          renderer_settings.integrator = sparks::INTEGRATOR_BDPT;
+        } else if (integrator == "ppm") {
+          renderer_settings.integrator = sparks::INTEGRATOR_PPM;
+        } else if (integrator != "path") {
+          LAND_WARN("Unknown integrator {}, using path", integrator);
+        }
+        renderer_settings.photons_per_pass = absl::GetFlag(FLAGS_photons_per_pass);
+        renderer_settings.photon_radius = absl::GetFlag(FLAGS_photon_radius);
+        std::string sampler = absl::GetFlag(FLAGS_sampler);
+        if (sampler == "independent") {
+          renderer_settings.sampler = sparks::SAMPLER_INDEPENDENT;
+        } else if (sampler == "halton") {
+          renderer_settings.sampler = sparks::SAMPLER_HALTON;
+        } else if (sampler != "sobol") {
+          LAND_WARN("Unknown sampler {}, using sobol", sampler);
+        }
+        renderer_settings.blue_noise = absl::GetFlag(FLAGS_blue_noise);
+        std::string light_sampling = absl::GetFlag(FLAGS_light_sampling);
+        if (light_sampling == "area") {
+          renderer_settings.light_sampling = sparks::LIGHT_SAMPLING_AREA;
+        } else if (light_sampling == "power") {
+          renderer_settings.light_sampling = sparks::LIGHT_SAMPLING_POWER;
+        } else if (light_sampling != "tree") {
+          LAND_WARN("Unknown light sampling {}, using tree", light_sampling);
+        }
+        renderer_settings.checkpoint_path = absl::GetFlag(FLAGS_checkpoint);
+        renderer_settings.checkpoint_interval =
+            absl::GetFlag(FLAGS_checkpoint_interval);
         sparks::Renderer renderer(renderer_settings);
-        RunApp(&renderer);
+        if (absl::GetFlag(FLAGS_headless)) {
+          RunHeadless(&renderer);
+        } else {
+          RunApp(&renderer);
+        }
+        sparks::ReportCheckFailures();
+        sparks::ReportLogCounts();
       }
       else {
         test_main();
@@ -67,10 +154,144 @@ void RunApp(sparks::Renderer *renderer) {
   app_settings.height = absl::GetFlag(FLAGS_height);
   app_settings.hardware_renderer = absl::GetFlag(FLAGS_vkrt);
   app_settings.selected_device = absl::GetFlag(FLAGS_device);
+  app_settings.resume = absl::GetFlag(FLAGS_resume);
   sparks::App app(renderer, app_settings);
   app.Run();
 }
 
+void RunHeadless(sparks::Renderer *renderer) {
+  uint32_t width = absl::GetFlag(FLAGS_width);
+  uint32_t height = absl::GetFlag(FLAGS_height);
+  uint32_t spp = absl::GetFlag(FLAGS_spp);
+  if (!absl::GetFlag(FLAGS_scene).empty()) {
+    renderer->LoadScene(absl::GetFlag(FLAGS_scene));
+  }
+  std::vector<glm::vec4> image;
+  std::string connect = absl::GetFlag(FLAGS_connect);
+  if (absl::GetFlag(FLAGS_coordinator_port)) {
+    // Viewers watch the merged partial buffers, then the final image
+    sparks::SharedFramebuffer shared_framebuffer;
+    if (!absl::GetFlag(FLAGS_shm_name).empty()) {
+      shared_framebuffer.Open(absl::GetFlag(FLAGS_shm_name), width, height,
+                              absl::GetFlag(FLAGS_shm_unlink));
+    }
+    if (!sparks::RunRenderCoordinator(
+            uint16_t(absl::GetFlag(FLAGS_coordinator_port)),
+            absl::GetFlag(FLAGS_num_workers), width, height, spp, image,
+            [&shared_framebuffer](const std::vector<glm::vec4> &color,
+                                  const std::vector<float> &number,
+                                  uint32_t samples) {
+              shared_framebuffer.Publish(color.data(), number.data(), samples);
+            })) {
+      return;
+    }
+    shared_framebuffer.Publish(image.data(),
+                               std::vector<float>(image.size(), 1.0f).data(),
+                               spp);
+  } else if (!connect.empty()) {
+    auto colon = connect.rfind(':');
+    if (colon == std::string::npos) {
+      LAND_ERROR("Expected host:port, got {}", connect);
+      return;
+    }
+    sparks::RunRenderWorker(renderer, connect.substr(0, colon),
+                            uint16_t(std::stoi(connect.substr(colon + 1))),
+                            absl::GetFlag(FLAGS_stream_interval));
+    return;
+  } else {
+    // Tiles stop at spp, and the image is captured once the last one landed
+    renderer->GetRendererSettings().sample_target = std::max(spp, 1u);
+    renderer->StartWorkerThreads();
+    renderer->Resize(width, height);
+    if (absl::GetFlag(FLAGS_resume)) {
+      renderer->LoadCheckpoint(renderer->GetRendererSettings().checkpoint_path);
+    }
+    sparks::SharedFramebuffer shared_framebuffer;
+    if (!absl::GetFlag(FLAGS_shm_name).empty()) {
+      shared_framebuffer.Open(absl::GetFlag(FLAGS_shm_name), width, height,
+                              absl::GetFlag(FLAGS_shm_unlink));
+    }
+    while (!renderer->WaitForSampleTarget(std::chrono::milliseconds(100)) &&
+           !renderer->IsBudgetExhausted()) {
+      shared_framebuffer.Publish(renderer);
+    }
+    shared_framebuffer.Publish(renderer);
+    image = renderer->CaptureRenderedImage();
+    renderer->StopWorkers();
+  }
+
+  // Compare integrators at equal time against a converged render
+  std::string reference_path = absl::GetFlag(FLAGS_reference);
+  sparks::Texture reference;
+  if (!reference_path.empty()) {
+    if (!sparks::Texture::Load(reference_path, reference) ||
+        reference.GetWidth() != width || reference.GetHeight() != height) {
+      LAND_WARN("Reference {} missing or not {}x{}", reference_path, width,
+                height);
+    } else {
+      double squared_error = 0.0;
+      for (uint32_t i = 0; i < width * height; i++) {
+        glm::vec3 diff = glm::vec3{image[i]} - glm::vec3{reference.GetBuffer()[i]};
+        squared_error += glm::dot(diff, diff) / 3.0f;
+      }
+      LAND_INFO("Headless: RMSE {} against {}",
+                std::sqrt(squared_error / double(width * height)),
+                reference_path);
+    }
+  }
+
+  std::string output = absl::GetFlag(FLAGS_output);
+  if (!absl::EndsWithIgnoreCase(output, ".hdr")) {
+    float inv_gamma = 1.0f / renderer->GetScene().GetCamera().GetGamma();
+    for (auto &pixel : image) {
+      pixel = glm::vec4{glm::pow(glm::vec3{pixel}, glm::vec3{inv_gamma}), 1.0f};
+    }
+  }
+  sparks::Texture(width, height, image.data(), sparks::SAMPLE_TYPE_LINEAR)
+      .Store(output);
+  LAND_INFO("Headless: wrote {}", output);
+}
+
+// Mean radiance of one camera ray, rendered with a survival probability of
+// Russian roulette
+double FurnaceMean(const sparks::Scene &scene, float prob_rr) {
+  sparks::RendererSettings settings;
+  settings.prob_rr = prob_rr;
+  settings.max_color = 1e9f; // Clamping would bias the noisier estimate
+  settings.sampler = sparks::SAMPLER_INDEPENDENT;
+  sparks::PathTracer path_tracer(&settings, &scene);
+  const uint32_t num_samples = 1u << 18;
+  double sum = 0.0;
+  for (uint32_t i = 0; i < num_samples; i++) {
+    path_tracer.GetSampler().StartSample(0, 0, i);
+    sum += path_tracer
+               .SampleRayPathTrace(glm::vec3{0.0f, 0.0f, 3.0f},
+                                   glm::vec3{0.0f, 0.0f, -1.0f}, 0.0f)
+               .x;
+  }
+  return sum / double(num_samples);
+}
+
 void test_main() {
-  return;
+  // Furnace: a principled sphere under a white envmap. Russian roulette only
+  // adds noise, and emission found by BSDF samples counts once either way
+  sparks::Scene scene;
+  scene.GetEnvmapId() = 0; // Pure white
+  scene.UpdateEnvmapConfiguration();
+  sparks::Material material;
+  material.material_type = sparks::MATERIAL_TYPE_PRINCIPLED;
+  material.albedo_color = glm::vec3{0.8f};
+  material.roughness = 0.5f;
+  scene.AddEntity(std::make_unique<sparks::AcceleratedMesh>(sparks::Mesh::Sphere()),
+                  material, glm::mat4{1.0f}, std::string("Furnace Sphere"));
+  scene.UpdateBsdfs();
+  double mean_full = FurnaceMean(scene, 1.0f);
+  double mean_half = FurnaceMean(scene, 0.5f);
+  if (std::abs(mean_full - mean_half) > 0.01 * mean_full) {
+    LAND_ERROR("Furnace: mean {} with prob_rr 1.0 but {} with 0.5", mean_full,
+               mean_half);
+  } else {
+    LAND_INFO("Furnace: mean {} with prob_rr 1.0, {} with 0.5", mean_full,
+              mean_half);
+  }
 }
\ No newline at end of file
@@ -26,7 +26,7 @@ public:
     const glm::vec3& ray_out,
     glm::vec3* ray_in,
     float* pdf,
-    std::mt19937& rng, bool is_front_face) const = 0;
+    Sampler& sampler, bool is_front_face) const = 0;
 
   const BxdfType bxdf_type;
 };
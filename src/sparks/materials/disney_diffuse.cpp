@@ -1,4 +1,5 @@
 #include "disney_diffuse.h"
+#include "sparks/util/check.h"
 
 namespace sparks {
 float DisneyDiffuse::GetPdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const
@@ -14,15 +15,9 @@ float DisneyDiffuse::GetPdf(const glm::vec3& normal, const glm::vec3& ray_out, c
 
 glm::vec3 DisneyDiffuse::GetBsdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const
 {
-	if (glm::abs(glm::length(normal) - 1.0f) > 1e-3f) {
-		LAND_ERROR("Unnormalized normal {}", glm::to_string(normal));
-	}
-	if (glm::abs(glm::length(ray_out) - 1.0f) > 1e-3f) {
-		LAND_ERROR("Unnormalized ray out {}", glm::to_string(ray_out));
-	}
-	if (glm::abs(glm::length(ray_in) - 1.0f) > 1e-3f) {
-		LAND_ERROR("Unnormalized ray in {}", glm::to_string(ray_in));
-	}
+	SPARKS_CHECK_NORMALIZED(normal, 1e-3f, "Unnormalized normal");
+	SPARKS_CHECK_NORMALIZED(ray_out, 1e-3f, "Unnormalized ray out");
+	SPARKS_CHECK_NORMALIZED(ray_in, 1e-3f, "Unnormalized ray in");
 	float cos_theta_out = glm::abs(glm::dot(normal, ray_out));
 	float cos_theta_in = glm::abs(glm::dot(normal, ray_in));
 	float f_out = pow5(cos_theta_out);
@@ -30,12 +25,12 @@ glm::vec3 DisneyDiffuse::GetBsdf(const glm::vec3& normal, const glm::vec3& ray_o
 	return base_color_ * INV_PI * (1 - f_out / 2) * (1 - f_in / 2);
 }
 
-glm::vec3 DisneyDiffuse::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, std::mt19937& rng, bool is_front_face) const
+glm::vec3 DisneyDiffuse::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, Sampler& sampler, bool is_front_face) const
 {
 	//if (glm::dot(normal, ray_out) < 0) {
 	//	LAND_WARN("Opposite direction of out ray and normal! {}", glm::dot(normal, ray_out));
 	//}
-	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, rng, pdf);
+	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, sampler, pdf);
 	*ray_in = -ray_in_reverse;
 	return GetBsdf(normal, ray_out, *ray_in, is_front_face);
 }
@@ -33,12 +33,12 @@ glm::vec3 sparks::DisneyFakess::GetBsdf(const glm::vec3& normal, const glm::vec3
 	return base_color_ * INV_PI * ss;
 }
 
-glm::vec3 sparks::DisneyFakess::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, std::mt19937& rng, bool is_front_face) const
+glm::vec3 sparks::DisneyFakess::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, Sampler& sampler, bool is_front_face) const
 {
 	//if (glm::dot(normal, ray_out) < 0) {
 	//	LAND_WARN("Opposite direction of out ray and normal! {}", glm::dot(normal, ray_out));
 	//}
-	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, rng, pdf);
+	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, sampler, pdf);
 	*ray_in = -ray_in_reverse;
 	return GetBsdf(normal, ray_out, *ray_in, is_front_face);
 }
@@ -4,7 +4,7 @@
 
 namespace sparks {
 // fake subsurface scattering
-class DisneyFakess : public Bxdf {
+class DisneyFakess final : public Bxdf {
 public:
   DisneyFakess(const glm::vec3& base_color, float roughness) :
     Bxdf(BxdfType(BSDF_DIFFUSE | BSDF_SPECULAR)), base_color_(base_color), roughness_(roughness) {}
@@ -18,7 +18,7 @@ public:
     const glm::vec3& ray_out,
     glm::vec3* ray_in,
     float* pdf,
-    std::mt19937& rng, bool is_front_face) const;
+    Sampler& sampler, bool is_front_face) const;
 private:
   glm::vec3 base_color_;
   float roughness_;
@@ -29,9 +29,9 @@ glm::vec3 sparks::DisneyRetro::GetBsdf(const glm::vec3& normal, const glm::vec3&
 	return base_color_ * INV_PI * rr * (f_out + f_in + f_out * f_in * (rr - 1));
 }
 
-glm::vec3 sparks::DisneyRetro::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, std::mt19937& rng, bool is_front_face) const
+glm::vec3 sparks::DisneyRetro::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, Sampler& sampler, bool is_front_face) const
 {
-	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, rng, pdf);
+	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, sampler, pdf);
 	*ray_in = -ray_in_reverse;
 	return GetBsdf(normal, ray_out, *ray_in, is_front_face);
 }
@@ -2,7 +2,7 @@
 #include "bxdf.h"
 
 namespace sparks {
-  class DisneyRetro : public Bxdf {
+  class DisneyRetro final : public Bxdf {
   public:
     DisneyRetro(const glm::vec3& base_color, float roughness) :
       Bxdf(BxdfType(BSDF_DIFFUSE | BSDF_SPECULAR)), base_color_(base_color), roughness_(roughness) {}
@@ -16,7 +16,7 @@ namespace sparks {
       const glm::vec3& ray_out,
       glm::vec3* ray_in,
       float* pdf,
-      std::mt19937& rng, bool is_front_face) const;
+      Sampler& sampler, bool is_front_face) const;
   private:
     glm::vec3 base_color_;
     float roughness_;
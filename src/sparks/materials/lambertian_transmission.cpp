@@ -16,9 +16,9 @@ glm::vec3 LambertianTransmission::GetBsdf(const glm::vec3& normal, const glm::ve
 	return base_color_ * INV_PI;
 }
 
-glm::vec3 LambertianTransmission::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, std::mt19937& rng, bool is_front_face) const
+glm::vec3 LambertianTransmission::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, Sampler& sampler, bool is_front_face) const
 {
-	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, rng, pdf);
+	glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, sampler, pdf);
 	if (glm::dot(normal, ray_in_reverse) * glm::dot(normal, ray_out) > 0) { // same direction
 		*ray_in = ray_in_reverse;
 	}
@@ -2,7 +2,7 @@
 #include "bxdf.h"
 
 namespace sparks {
-  class LambertianTransmission : public Bxdf {
+  class LambertianTransmission final : public Bxdf {
   public:
     LambertianTransmission(const glm::vec3& base_color) :
       Bxdf(BxdfType(BSDF_TRANSMISSIVE | BSDF_DIFFUSE)), base_color_(base_color) {}
@@ -16,7 +16,7 @@ namespace sparks {
       const glm::vec3& ray_out,
       glm::vec3* ray_in,
       float* pdf,
-      std::mt19937& rng, bool is_front_face) const;
+      Sampler& sampler, bool is_front_face) const;
   private:
     glm::vec3 base_color_;
   };
@@ -1,4 +1,5 @@
 #include "microfacet_reflection.h"
+#include "sparks/util/check.h"
 #include <algorithm>
 
 namespace sparks {
@@ -31,7 +32,7 @@ float MicrofacetReflection::GetPdf(const glm::vec3& normal, const glm::vec3& ray
   glm::vec3 ray_in_reverse = -ray_in;
   if (glm::dot(normal, ray_in_reverse) * glm::dot(normal, ray_out) < 0.0f) return 0;
   glm::vec3 ray_half = glm::normalize(ray_out + ray_in_reverse);
-  return distribution_->Pdf(ray_out, ray_half) / (4 * glm::dot (ray_out, ray_half));
+  return distribution_.Pdf(ray_out, ray_half) / (4 * glm::dot (ray_out, ray_half));
 }
 
 glm::vec3 MicrofacetReflection::GetBsdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const
@@ -49,16 +50,16 @@ glm::vec3 MicrofacetReflection::GetBsdf(const glm::vec3& normal, const glm::vec3
   if (glm::dot(ray_half, normal) < 0.0f) {
     ray_half = -ray_half;
   }
-  glm::vec3 F = fresnel_->Evaluate(glm::dot(ray_in_reverse, ray_half));
-  return base_color_ * distribution_->D(ray_half) * distribution_->G(ray_out, ray_in_reverse) * F /
+  glm::vec3 F = fresnel_.Evaluate(glm::dot(ray_in_reverse, ray_half));
+  return base_color_ * distribution_.D(ray_half) * distribution_.G(ray_out, ray_in_reverse) * F /
     (4 * cos_theta_in * cos_theta_out);
 }
 
-glm::vec3 MicrofacetReflection::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, std::mt19937& rng, bool is_front_face) const
+glm::vec3 MicrofacetReflection::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, Sampler& sampler, bool is_front_face) const
 {
   // Sample microfacet orientation $\wh$ and reflected direction $\wi$
   if (glm::dot(normal, ray_out) == 0) return glm::vec3{ 0.0f };
-  glm::vec3 ray_half = distribution_->SampleWh(ray_out, rng);
+  glm::vec3 ray_half = distribution_.SampleWh(ray_out, sampler);
   if (glm::dot(ray_out, ray_half) < 0) return glm::vec3{ 0.0f };   // Should be rare
   *ray_in = glm::reflect(ray_out, ray_half);
   //if (!SameHemisphere(wo, *wi)) return Spectrum(0.f);
@@ -99,7 +100,7 @@ float MicrofacetTransmission::GetPdf(const glm::vec3& normal, const glm::vec3& r
   float d_ray_half_d_ray_in_rev =
     std::abs((ior * ior * glm::dot(ray_in_reverse, ray_half)) / (sqrt_denom * sqrt_denom));
   //LAND_INFO("sqrt_denom {}, d_ray_half_d_ray_in_rev {}", sqrt_denom, d_ray_half_d_ray_in_rev);
-  return distribution_->Pdf(ray_out, ray_half) * d_ray_half_d_ray_in_rev;
+  return distribution_.Pdf(ray_out, ray_half) * d_ray_half_d_ray_in_rev;
 }
 
 glm::vec3 MicrofacetTransmission::GetBsdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const
@@ -134,12 +135,12 @@ glm::vec3 MicrofacetTransmission::GetBsdf(const glm::vec3& normal, const glm::ve
   float factor = 1 / ior;
 
   return (1.0f - F) * base_color_ *
-    glm::abs(distribution_->D(ray_half) * distribution_->G(ray_out, ray_in_reverse) * ior * ior *
+    glm::abs(distribution_.D(ray_half) * distribution_.G(ray_out, ray_in_reverse) * ior * ior *
       glm::abs(glm::dot(ray_in_reverse, ray_half)) * glm::abs(glm::dot(ray_out, ray_half)) * factor * factor /
       (cos_theta_in * cos_theta_out * sqrt_denom * sqrt_denom));
 }
 
-glm::vec3 MicrofacetTransmission::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, std::mt19937& rng, bool is_front_face) const
+glm::vec3 MicrofacetTransmission::SampleRayIn(const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, Sampler& sampler, bool is_front_face) const
 {
   //glm::vec3 out_normal; // normal pointing outwards
   //if (is_front_face) {
@@ -150,10 +151,8 @@ glm::vec3 MicrofacetTransmission::SampleRayIn(const glm::vec3& normal, const glm
   //}
   // Sample microfacet orientation $\wh$ and reflected direction $\wi$
   if (glm::dot(normal, ray_out) == 0) return glm::vec3{ 0.0f };
-  glm::vec3 ray_half = distribution_->SampleWh(ray_out, rng);
-  if (glm::abs(glm::length(ray_half) - 1.0f) > 1e-5f) {
-    LAND_ERROR("Unnormalized ray half! {}", glm::length(ray_half));
-  }
+  glm::vec3 ray_half = distribution_.SampleWh(ray_out, sampler);
+  SPARKS_CHECK_NORMALIZED(ray_half, 1e-5f, "Unnormalized ray half");
   if (glm::dot(ray_out, ray_half) < 0) return glm::vec3{ 0.0f };   // Should be rare
 
   float cos_theta_out = glm::dot(normal, ray_out);
@@ -23,11 +23,11 @@ private:
   const float metallic_, ior_;
 };
 
-class MicrofacetReflection : public Bxdf {
+class MicrofacetReflection final : public Bxdf {
 public:
   MicrofacetReflection(const glm::vec3& base_color,
-    std::unique_ptr<MicrofacetDistribution> distribution, std::unique_ptr<Fresnel> fresnel) :
-    Bxdf(BxdfType(BSDF_SPECULAR)), base_color_(base_color), distribution_(std::move(distribution)), fresnel_(std::move(fresnel)) {}
+    const MicrofacetDistribution& distribution, const Fresnel& fresnel) :
+    Bxdf(BxdfType(BSDF_SPECULAR)), base_color_(base_color), distribution_(distribution), fresnel_(fresnel) {}
   float GetPdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const;
   glm::vec3 GetBsdf(
     const glm::vec3& normal,
@@ -38,12 +38,12 @@ public:
     const glm::vec3& ray_out,
     glm::vec3* ray_in,
     float* pdf,
-    std::mt19937& rng, bool is_front_face) const;
+    Sampler& sampler, bool is_front_face) const;
 private:
   //glm::vec3 World2Tangent_(const glm::vec3& normal, const glm::vec3& w);
   const glm::vec3 base_color_;
-  std::unique_ptr<MicrofacetDistribution> distribution_;
-  std::unique_ptr<Fresnel> fresnel_;
+  const MicrofacetDistribution distribution_;
+  const Fresnel fresnel_;
 };
 
 class FresnelDielectric{
@@ -59,11 +59,11 @@ private:
 };
 
 // The normal here always points to
-class MicrofacetTransmission : public Bxdf {
+class MicrofacetTransmission final : public Bxdf {
 public:
   MicrofacetTransmission(const glm::vec3& base_color,
-    std::unique_ptr<MicrofacetDistribution> distribution, float ior_a, float ior_b) :
-    Bxdf(BxdfType(BSDF_SPECULAR)), base_color_(base_color), distribution_(std::move(distribution)), 
+    const MicrofacetDistribution& distribution, float ior_a, float ior_b) :
+    Bxdf(BxdfType(BSDF_SPECULAR)), base_color_(base_color), distribution_(distribution), 
     ior_a_(ior_a), ior_b_(ior_b), fresnel_(ior_a, ior_b) {}
   float GetPdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const;
   glm::vec3 GetBsdf(
@@ -75,11 +75,11 @@ public:
     const glm::vec3& ray_out,
     glm::vec3* ray_in,
     float* pdf,
-    std::mt19937& rng, bool is_front_face) const;
+    Sampler& sampler, bool is_front_face) const;
 private:
   //glm::vec3 World2Tangent_(const glm::vec3& normal, const glm::vec3& w);
   const glm::vec3 base_color_;
-  std::unique_ptr<MicrofacetDistribution> distribution_;
+  const MicrofacetDistribution distribution_;
   const FresnelDielectric fresnel_;
   const float ior_a_, ior_b_; // air, material ior
 };
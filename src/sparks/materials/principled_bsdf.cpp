@@ -0,0 +1,171 @@
+#include "principled_bsdf.h"
+
+#include "bxdfs_all.h"
+#include "sparks/util/log.h"
+
+namespace sparks {
+namespace {
+/* Call func with the lobe as a concrete Bxdf built on the stack. The static
+* type is known, so func calls the Bxdf methods directly.
+*/
+template <class Func>
+auto VisitLobe(const BsdfLobe &lobe, const glm::vec3 &normal, Func &&func) {
+  switch (lobe.type) {
+  case BSDF_LOBE_DISNEY_DIFFUSE:
+    return func(DisneyDiffuse(lobe.color));
+  case BSDF_LOBE_DISNEY_FAKESS:
+    return func(DisneyFakess(lobe.color, lobe.roughness));
+  case BSDF_LOBE_DISNEY_RETRO:
+    return func(DisneyRetro(lobe.color, lobe.roughness));
+  case BSDF_LOBE_MICROFACET_REFLECTION:
+    return func(MicrofacetReflection(
+      lobe.color, MicrofacetDistribution(lobe.alpha_x, lobe.alpha_y, normal),
+      Fresnel(lobe.c_spec0, lobe.metallic, lobe.ior)));
+  case BSDF_LOBE_MICROFACET_TRANSMISSION:
+    return func(MicrofacetTransmission(
+      lobe.color, MicrofacetDistribution(lobe.alpha_x, lobe.alpha_y, normal),
+      1.0f, lobe.ior));
+  default:
+    return func(LambertianTransmission(lobe.color));
+  }
+}
+}  // namespace
+
+// Based on https://github.com/mmp/pbrt-v3/
+PrincipledBsdf::PrincipledBsdf(const Material& material) {
+  if (material.material_type != MATERIAL_TYPE_PRINCIPLED) {
+    return;
+  }
+  glm::vec3 color = material.albedo_color;
+  float metallic_weight = material.metallic;
+  float ior = material.ior;
+  float spec_trans = material.spec_trans;
+  float diffuse_weight = (1 - metallic_weight) * (1 - spec_trans);
+  float diff_trans = material.diff_trans; // 0: all reflect -> 1: all transmit
+  float rough = material.roughness;
+  BsdfLobe lobe;
+  lobe.color = color;
+  lobe.roughness = rough;
+
+  if (diffuse_weight > 0) {
+    if (material.thin) {
+      float flat = material.flatness;
+      lobe.type = BSDF_LOBE_DISNEY_DIFFUSE;
+      AddLobe_(lobe, diffuse_weight * (1 - flat) * (1 - diff_trans));
+      lobe.type = BSDF_LOBE_DISNEY_FAKESS;
+      AddLobe_(lobe, diffuse_weight * flat * (1 - diff_trans));
+    }
+    else {
+      SPARKS_LOG_ERROR("Not implemented for thick material!");
+    }
+    // Retro-reflection.
+    lobe.type = BSDF_LOBE_DISNEY_RETRO;
+    AddLobe_(lobe, diffuse_weight);
+  }
+  // microfacet distribution
+  float aspect = 1.0f; // fix anisotrophic=0.0f
+  // Add weight according to spec_trans
+  float reflect_weight = glm::max(1e-3f, 1 - spec_trans);
+  BsdfLobe reflection;
+  reflection.type = BSDF_LOBE_MICROFACET_REFLECTION;
+  reflection.color = glm::vec3{ 1.0f / reflect_weight };
+  reflection.alpha_x = glm::max(1e-3f, rough * rough / aspect);
+  reflection.alpha_y = glm::max(1e-3f, rough * rough * aspect);
+  reflection.c_spec0 = linear_interpolate(metallic_weight, glm::vec3{ (ior - 1) * (ior - 1) / (ior + 1) / (ior + 1) }, color);
+  reflection.metallic = metallic_weight;
+  reflection.ior = ior;
+  AddLobe_(reflection, reflect_weight);
+
+  // transmission
+  if (spec_trans > 0.0f) {
+    if (material.thin) {
+      // Walter et al's model, with the provided transmissive term scaled
+      // by sqrt(color), so that after two refractions, we're back to the
+      // provided color.
+      // Scale roughness based on IOR (Burley 2015, Figure 15).
+      float rscaled = (0.65f * ior - 0.35f) * rough;
+      BsdfLobe transmission;
+      transmission.type = BSDF_LOBE_MICROFACET_TRANSMISSION;
+      transmission.color = glm::sqrt(color);
+      transmission.alpha_x = glm::max(1e-3f, rscaled * rscaled / aspect);
+      transmission.alpha_y = glm::max(1e-3f, rscaled * rscaled * aspect);
+      transmission.ior = ior;
+      AddLobe_(transmission, spec_trans);
+    }
+    else {
+      SPARKS_LOG_ERROR("Transmission not implemented for thick material!");
+    }
+  }
+  if (material.thin) {
+    lobe.type = BSDF_LOBE_LAMBERTIAN_TRANSMISSION;
+    AddLobe_(lobe, diff_trans);
+  }
+
+  // Normalize the CDF. The reflection lobe keeps the total positive
+  float total = cdf_[num_lobes_ - 1];
+  for (int i = 0; i < num_lobes_; i++) {
+    cdf_[i] /= total;
+  }
+  cdf_[num_lobes_ - 1] = 1.0f;
+}
+
+void PrincipledBsdf::AddLobe_(const BsdfLobe& lobe, float weight) {
+  lobes_[num_lobes_] = lobe;
+  cdf_[num_lobes_] = (num_lobes_ ? cdf_[num_lobes_ - 1] : 0.0f) + glm::max(weight, 0.0f);
+  num_lobes_++;
+}
+
+float PrincipledBsdf::GetLobeWeight_(int lobe) const {
+  return cdf_[lobe] - (lobe ? cdf_[lobe - 1] : 0.0f);
+}
+
+int PrincipledBsdf::SampleLobe(Sampler& sampler) const {
+  float u = sampler.Get1D();
+  int lobe = 0;
+  // Lobes of zero weight are never picked, their CDF equals the previous one
+  while (lobe < num_lobes_ - 1 && u >= cdf_[lobe]) {
+    lobe++;
+  }
+  return lobe;
+}
+
+float PrincipledBsdf::GetPdf(int lobe, const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const {
+  return VisitLobe(lobes_[lobe], normal, [&](const auto& bxdf) {
+    return bxdf.GetPdf(normal, ray_out, ray_in, is_front_face);
+  });
+}
+
+glm::vec3 PrincipledBsdf::GetBsdf(int lobe, const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const {
+  return VisitLobe(lobes_[lobe], normal, [&](const auto& bxdf) {
+    return bxdf.GetBsdf(normal, ray_out, ray_in, is_front_face);
+  });
+}
+
+float PrincipledBsdf::GetPdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const {
+  float pdf = 0.0f;
+  for (int i = 0; i < num_lobes_; i++) {
+    float weight = GetLobeWeight_(i);
+    if (weight > 0.0f) {
+      pdf += weight * GetPdf(i, normal, ray_out, ray_in, is_front_face);
+    }
+  }
+  return pdf;
+}
+
+glm::vec3 PrincipledBsdf::GetBsdf(const glm::vec3& normal, const glm::vec3& ray_out, const glm::vec3& ray_in, bool is_front_face) const {
+  glm::vec3 bsdf{ 0.0f };
+  for (int i = 0; i < num_lobes_; i++) {
+    float weight = GetLobeWeight_(i);
+    if (weight > 0.0f) {
+      bsdf += weight * GetBsdf(i, normal, ray_out, ray_in, is_front_face);
+    }
+  }
+  return bsdf;
+}
+
+glm::vec3 PrincipledBsdf::SampleRayIn(int lobe, const glm::vec3& normal, const glm::vec3& ray_out, glm::vec3* ray_in, float* pdf, Sampler& sampler, bool is_front_face) const {
+  return VisitLobe(lobes_[lobe], normal, [&](const auto& bxdf) {
+    return bxdf.SampleRayIn(normal, ray_out, ray_in, pdf, sampler, is_front_face);
+  });
+}
+}  // namespace sparks
@@ -0,0 +1,85 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "sparks/assets/material.h"
+#include "sparks/util/sampler.h"
+
+namespace sparks {
+enum BsdfLobeType : int {
+  BSDF_LOBE_DISNEY_DIFFUSE,
+  BSDF_LOBE_DISNEY_FAKESS,
+  BSDF_LOBE_DISNEY_RETRO,
+  BSDF_LOBE_MICROFACET_REFLECTION,
+  BSDF_LOBE_MICROFACET_TRANSMISSION,
+  BSDF_LOBE_LAMBERTIAN_TRANSMISSION
+};
+
+/* @brief One lobe of a principled BSDF, tagged by its type. The lobe types
+* share these parameters, each one reads those it needs.
+*/
+struct BsdfLobe {
+  BsdfLobeType type{BSDF_LOBE_DISNEY_DIFFUSE};
+  glm::vec3 color{0.0f}; // base color, or the scale of a microfacet lobe
+  float roughness{0.0f};
+  float alpha_x{0.0f};
+  float alpha_y{0.0f};
+  glm::vec3 c_spec0{0.0f}; // Fresnel of the microfacet reflection
+  float metallic{0.0f};
+  float ior{1.0f};
+};
+
+/* @brief The lobes of a principled material and the CDF that picks one of
+* them, built once per material. Lobes are stored inline and evaluated through
+* a switch on their type, so shading allocates nothing and makes no virtual
+* calls. Lobes depending on the shading normal take it at evaluation.
+*/
+class PrincipledBsdf {
+ public:
+  static constexpr int kMaxLobes = 6;
+
+  PrincipledBsdf() = default;
+  // Empty unless material is MATERIAL_TYPE_PRINCIPLED
+  explicit PrincipledBsdf(const Material &material);
+
+  [[nodiscard]] int GetLobeCount() const {
+    return num_lobes_;
+  }
+  // Pick a lobe in proportion to its weight
+  [[nodiscard]] int SampleLobe(Sampler &sampler) const;
+
+  [[nodiscard]] float GetPdf(int lobe,
+                             const glm::vec3 &normal,
+                             const glm::vec3 &ray_out,
+                             const glm::vec3 &ray_in,
+                             bool is_front_face) const;
+  [[nodiscard]] glm::vec3 GetBsdf(int lobe,
+                                  const glm::vec3 &normal,
+                                  const glm::vec3 &ray_out,
+                                  const glm::vec3 &ray_in,
+                                  bool is_front_face) const;
+  // All lobes, mixed by their weights, as the lobe sampling averages them
+  [[nodiscard]] float GetPdf(const glm::vec3 &normal,
+                             const glm::vec3 &ray_out,
+                             const glm::vec3 &ray_in,
+                             bool is_front_face) const;
+  [[nodiscard]] glm::vec3 GetBsdf(const glm::vec3 &normal,
+                                  const glm::vec3 &ray_out,
+                                  const glm::vec3 &ray_in,
+                                  bool is_front_face) const;
+  // @return BSDF
+  glm::vec3 SampleRayIn(int lobe,
+                        const glm::vec3 &normal,
+                        const glm::vec3 &ray_out,
+                        glm::vec3 *ray_in,
+                        float *pdf,
+                        Sampler &sampler,
+                        bool is_front_face) const;
+
+ private:
+  BsdfLobe lobes_[kMaxLobes]{};
+  float cdf_[kMaxLobes]{}; // cdf_[i] = sum of the normalized weights of lobes 0..i
+  int num_lobes_{0};
+
+  void AddLobe_(const BsdfLobe &lobe, float weight);
+  [[nodiscard]] float GetLobeWeight_(int lobe) const;
+};
+}  // namespace sparks
@@ -0,0 +1,416 @@
+#include "sparks/renderer/bdpt.h"
+
+#include "sparks/util/sample.h"
+#include "sparks/util/util.h"
+
+namespace sparks {
+namespace {
+// Densities of specular vertices are 0, they cancel out of the ratios
+float Remap0(float pdf) {
+  return pdf != 0.0f ? pdf : 1.0f;
+}
+
+bool SameSide(const glm::vec3 &normal, const glm::vec3 &a, const glm::vec3 &b) {
+  return glm::dot(normal, a) * glm::dot(normal, b) > 0.0f;
+}
+}  // namespace
+
+BdptIntegrator::BdptIntegrator(const RendererSettings *render_settings)
+    : render_settings_(render_settings),
+      path_tracer_(render_settings, nullptr) {
+}
+
+void BdptIntegrator::SetScene(const Scene *scene) {
+  scene_ = scene;
+  path_tracer_.SetScene(scene);
+}
+
+int BdptIntegrator::GetMaxDepth_() const {
+  return render_settings_->num_bounces + 1;
+}
+
+glm::vec3 BdptIntegrator::SampleRay(const glm::vec3 &origin,
+                                    const glm::vec3 &direction,
+                                    float time) {
+  time_ = time;
+  int max_depth = GetMaxDepth_();
+  glm::vec3 radiance{0.0f};
+  camera_path_.clear();
+  Vertex camera;
+  camera.type = VERTEX_CAMERA;
+  camera.position = origin;
+  camera_path_.push_back(camera);
+  // The pdf of the camera ray only matters to strategies with one camera vertex
+  RandomWalk_(direction, glm::vec3{1.0f}, 1.0f, max_depth + 2, &camera_path_,
+              &radiance);
+  TraceLightPath_();
+
+  int num_light_vertices = std::max(int(light_path_.size()), 1);
+  for (int t = 2; t <= int(camera_path_.size()); t++) {
+    for (int s = 0; s <= num_light_vertices && s + t - 2 <= max_depth; s++) {
+      radiance += Connect_(s, t);
+    }
+  }
+  radiance.x = clamp(radiance.x, 0.0f, render_settings_->max_color);
+  radiance.y = clamp(radiance.y, 0.0f, render_settings_->max_color);
+  radiance.z = clamp(radiance.z, 0.0f, render_settings_->max_color);
+  return radiance;
+}
+
+void BdptIntegrator::RandomWalk_(glm::vec3 direction,
+                                 glm::vec3 beta,
+                                 float pdf,
+                                 int max_vertices,
+                                 std::vector<Vertex> *path,
+                                 glm::vec3 *radiance) {
+  Sampler &sampler = GetSampler();
+  HitRecord hit_record;
+  while (int(path->size()) < max_vertices) {
+    float t = scene_->TraceRay(path->back().position, direction, time_, 1e-3f,
+                               1e4f, &hit_record);
+    if (t <= 0.0f) {
+      if (radiance) {
+        *radiance += beta * glm::vec3{scene_->SampleEnvmap(direction)};
+      }
+      return;
+    }
+    const Entity &entity = scene_->GetEntity(hit_record.hit_entity_id);
+    const Material &material = entity.GetMaterial();
+    Vertex vertex;
+    vertex.position = hit_record.position;
+    vertex.normal = path_tracer_.GetShadingNormal(hit_record, material);
+    vertex.beta = beta;
+    vertex.color = glm::vec3{scene_->GetTextures()[material.albedo_texture_id]
+                                 .Sample(hit_record.tex_coord)} *
+                   material.albedo_color;
+    vertex.entity = &entity;
+    vertex.front_face = hit_record.front_face;
+    vertex.pdf_fwd = ConvertDensity_(pdf, path->back(), vertex);
+    if (material.material_type == MATERIAL_TYPE_EMISSION) {
+      // Paths end at lights, as in PathTracer
+      vertex.emission = material.emission * material.emission_strength;
+      vertex.light_index = entity.GetLightIndex();
+      path->push_back(vertex);
+      return;
+    }
+    path->push_back(vertex);
+    if (int(path->size()) == max_vertices) {
+      return;
+    }
+
+    glm::vec3 wo = -direction;
+    glm::vec3 wi, weight;
+    float pdf_scatter;
+    if (!SampleBsdf_(vertex, wo, &wi, &weight, &pdf_scatter)) {
+      return;
+    }
+    // Russian roulette is left out of the pdfs, the weights still sum to one
+    float prob_rr = glm::min(
+        render_settings_->prob_rr,
+        glm::max(beta.x * weight.x, glm::max(beta.y * weight.y, beta.z * weight.z)));
+    if (sampler.Get1D() >= prob_rr) {
+      return;
+    }
+    Vertex &current = path->back();
+    float pdf_rev = 0.0f;
+    if (pdf_scatter == 0.0f) {
+      current.delta = true;
+    } else {
+      pdf_rev = GetBsdfPdf_(current, wi, wo);
+    }
+    Vertex &prev = (*path)[path->size() - 2];
+    prev.pdf_rev = ConvertDensity_(pdf_rev, current, prev);
+    beta *= weight / prob_rr;
+    direction = wi;
+    pdf = pdf_scatter;
+  }
+}
+
+void BdptIntegrator::TraceLightPath_() {
+  light_path_.clear();
+  Vertex light;
+  if (!SampleLightVertex_(&light)) {
+    return;
+  }
+  Sampler &sampler = GetSampler();
+  float pdf_dir;
+  glm::vec3 direction =
+      hemisphere_sample_cosine_weighted(light.normal, sampler, &pdf_dir);
+  if (sampler.Get1D() < 0.5f) { // Both sides emit
+    direction = -direction;
+  }
+  pdf_dir *= 0.5f;
+  if (pdf_dir <= 0.0f) {
+    return;
+  }
+  light_path_.push_back(light);
+  glm::vec3 beta = light.emission * glm::abs(glm::dot(light.normal, direction)) /
+                   (light.pdf_fwd * pdf_dir);
+  RandomWalk_(direction, beta, pdf_dir, GetMaxDepth_() + 1, &light_path_,
+              nullptr);
+}
+
+bool BdptIntegrator::SampleLightVertex_(Vertex *vertex) {
+  const Lights &lights = scene_->GetLights();
+  if (!lights.GetLightCount()) {
+    return false;
+  }
+  int light_index;
+  glm::vec3 position;
+  // No shading point is known to the light subpath, so lights are picked by
+  // area or power, never from the light tree
+  float pdf = lights.Sample(&light_index, &position, GetSampler());
+  if (pdf <= 0.0f) {
+    return false;
+  }
+  const Light *light = lights.GetLight(light_index);
+  vertex->type = VERTEX_LIGHT;
+  vertex->position = position;
+  vertex->normal = light->geometry->GetNormal();
+  vertex->emission = light->emission * light->emission_strength;
+  vertex->beta = vertex->emission / pdf;
+  vertex->light_index = light_index;
+  vertex->pdf_fwd = pdf;
+  return true;
+}
+
+glm::vec3 BdptIntegrator::Connect_(int s, int t) {
+  const Vertex &pt = camera_path_[t - 1];
+  const Vertex &pt_minus = camera_path_[t - 2];
+  Vertex sampled;
+  glm::vec3 contribution{0.0f};
+  if (s == 0) {
+    if (pt.emission == glm::vec3{0.0f}) {
+      return glm::vec3{0.0f};
+    }
+    contribution = pt.beta * pt.emission;
+    // Emitters that are not lights are only found by camera subpaths
+    if (pt.light_index < 0) {
+      return contribution;
+    }
+  } else {
+    if (s == 1 && !SampleLightVertex_(&sampled)) {
+      return glm::vec3{0.0f};
+    }
+    const Vertex &qs = s == 1 ? sampled : light_path_[s - 1];
+    glm::vec3 d = qs.position - pt.position;
+    float dist2 = glm::dot(d, d);
+    if (dist2 <= 0.0f) {
+      return glm::vec3{0.0f};
+    }
+    glm::vec3 w = d / glm::sqrt(dist2);
+    contribution = pt.beta *
+                   EvaluateBsdf_(pt, glm::normalize(pt_minus.position - pt.position), w) *
+                   qs.beta;
+    if (s > 1) {
+      contribution *= EvaluateBsdf_(
+          qs, glm::normalize(light_path_[s - 2].position - qs.position), -w);
+    }
+    contribution *= glm::abs(glm::dot(pt.normal, w)) *
+                    glm::abs(glm::dot(qs.normal, w)) / dist2;
+    if (contribution == glm::vec3{0.0f} || !Unoccluded_(pt, qs)) {
+      return glm::vec3{0.0f};
+    }
+  }
+  return contribution * MisWeight_(s, t, sampled);
+}
+
+float BdptIntegrator::MisWeight_(int s, int t, const Vertex &sampled) const {
+  if (s + t == 2) {
+    return 1.0f;
+  }
+  // Densities of the vertices next to the connection, as the strategy joins them
+  const Vertex &pt = camera_path_[t - 1];
+  const Vertex &pt_minus = camera_path_[t - 2];
+  const Vertex *qs = s == 0 ? nullptr : s == 1 ? &sampled : &light_path_[s - 1];
+  const Vertex *qs_minus = s > 1 ? &light_path_[s - 2] : nullptr;
+  float pt_rev = s > 0 ? GetPdf_(*qs, qs_minus, pt) : GetLightOriginPdf_(pt);
+  float pt_minus_rev = s > 0 ? GetPdf_(pt, qs, pt_minus) : GetLightPdf_(pt, pt_minus);
+  float qs_rev = s > 0 ? GetPdf_(pt, &pt_minus, *qs) : 0.0f;
+  float qs_minus_rev = s > 1 ? GetPdf_(*qs, &pt, *qs_minus) : 0.0f;
+
+  // The endpoints of the connection are never specular
+  auto camera_rev = [&](int i) {
+    return i == t - 1 ? pt_rev : i == t - 2 ? pt_minus_rev : camera_path_[i].pdf_rev;
+  };
+  auto camera_delta = [&](int i) { return i < t - 1 && camera_path_[i].delta; };
+  auto light_fwd = [&](int i) {
+    return s == 1 ? sampled.pdf_fwd : light_path_[i].pdf_fwd;
+  };
+  auto light_rev = [&](int i) {
+    return i == s - 1 ? qs_rev : i == s - 2 ? qs_minus_rev : light_path_[i].pdf_rev;
+  };
+  auto light_delta = [&](int i) { return i < s - 1 && light_path_[i].delta; };
+
+  // Ratios of the pdfs of the other strategies to this one
+  float sum = 0.0f;
+  float ratio = 1.0f;
+  for (int i = t - 1; i >= 2; i--) { // Down to two camera vertices
+    ratio *= Remap0(camera_rev(i)) / Remap0(camera_path_[i].pdf_fwd);
+    if (!camera_delta(i) && !camera_delta(i - 1)) {
+      sum += ratio;
+    }
+  }
+  ratio = 1.0f;
+  for (int i = s - 1; i >= 0; i--) {
+    ratio *= Remap0(light_rev(i)) / Remap0(light_fwd(i));
+    bool delta_light = i > 0 && light_delta(i - 1); // Area lights only
+    if (!light_delta(i) && !delta_light) {
+      sum += ratio;
+    }
+  }
+  return 1.0f / (1.0f + sum);
+}
+
+bool BdptIntegrator::Unoccluded_(const Vertex &a, const Vertex &b) const {
+  glm::vec3 d = b.position - a.position;
+  float dist = glm::length(d);
+  HitRecord hit_record;
+  float t = scene_->TraceRay(a.position, d / dist, time_, 1e-3f, 1e4f,
+                             &hit_record);
+  return t <= 0.0f || t >= dist - 1e-3f;
+}
+
+glm::vec3 BdptIntegrator::EvaluateBsdf_(const Vertex &vertex,
+                                        const glm::vec3 &wo,
+                                        const glm::vec3 &wi) const {
+  if (vertex.type != VERTEX_SURFACE) {
+    return glm::vec3{0.0f};
+  }
+  switch (vertex.entity->GetMaterial().material_type) {
+    case MATERIAL_TYPE_LAMBERTIAN:
+      return SameSide(vertex.normal, wo, wi) ? vertex.color * INV_PI
+                                             : glm::vec3{0.0f};
+    case MATERIAL_TYPE_PRINCIPLED:
+      return vertex.entity->GetBsdf().GetBsdf(vertex.normal, wo, -wi,
+                                              vertex.front_face);
+    default: // Specular and transmissive are delta, emitters do not scatter
+      return glm::vec3{0.0f};
+  }
+}
+
+float BdptIntegrator::GetBsdfPdf_(const Vertex &vertex,
+                                  const glm::vec3 &wo,
+                                  const glm::vec3 &wi) const {
+  if (vertex.type != VERTEX_SURFACE) {
+    return 0.0f;
+  }
+  switch (vertex.entity->GetMaterial().material_type) {
+    case MATERIAL_TYPE_LAMBERTIAN:
+      return SameSide(vertex.normal, wo, wi)
+                 ? glm::abs(glm::dot(vertex.normal, wi)) * INV_PI
+                 : 0.0f;
+    case MATERIAL_TYPE_PRINCIPLED:
+      return vertex.entity->GetBsdf().GetPdf(vertex.normal, wo, -wi,
+                                             vertex.front_face);
+    default:
+      return 0.0f;
+  }
+}
+
+bool BdptIntegrator::SampleBsdf_(const Vertex &vertex,
+                                 const glm::vec3 &wo,
+                                 glm::vec3 *wi,
+                                 glm::vec3 *weight,
+                                 float *pdf) {
+  Sampler &sampler = GetSampler();
+  const Material &material = vertex.entity->GetMaterial();
+  switch (material.material_type) {
+    case MATERIAL_TYPE_LAMBERTIAN: {
+      glm::vec3 normal =
+          glm::dot(vertex.normal, wo) < 0.0f ? -vertex.normal : vertex.normal;
+      *wi = hemisphere_sample_cosine_weighted(normal, sampler, pdf);
+      *weight = vertex.color;
+      return *pdf > 0.0f;
+    }
+    case MATERIAL_TYPE_SPECULAR:
+      *wi = glm::reflect(-wo, vertex.normal);
+      *weight = vertex.color;
+      *pdf = 0.0f;
+      return true;
+    case MATERIAL_TYPE_TRANSMISSIVE: {
+      float ior = material.ior;
+      glm::vec3 dir_in = -wo;
+      float ior_in_over_refract = vertex.front_face ? 1.0f / ior : ior;
+      glm::vec3 dir_refract =
+          glm::refract(dir_in, vertex.normal, ior_in_over_refract);
+      bool is_total_reflect = glm::length(dir_refract) < 1e-3f;
+      float fr = 1.0f;
+      if (!is_total_reflect) { // Schlick's approximation
+        float cos_thetai = -glm::dot(dir_in, vertex.normal);
+        float r0 = (1 - ior) * (1 - ior) / (1 + ior) / (1 + ior);
+        fr = r0 + (1 - r0) * pow5(1 - cos_thetai);
+      }
+      *wi = (is_total_reflect || sampler.Get1D() < fr)
+                ? glm::reflect(dir_in, vertex.normal)
+                : dir_refract;
+      *weight = vertex.color;
+      *pdf = 0.0f;
+      return true;
+    }
+    case MATERIAL_TYPE_PRINCIPLED: {
+      const PrincipledBsdf &bsdf = vertex.entity->GetBsdf();
+      int lobe = bsdf.SampleLobe(sampler);
+      glm::vec3 ray_in;
+      float pdf_lobe = 0.0f;
+      bsdf.SampleRayIn(lobe, vertex.normal, wo, &ray_in, &pdf_lobe, sampler,
+                       vertex.front_face);
+      if (pdf_lobe <= 0.0f) {
+        return false;
+      }
+      // The other lobes could have sampled ray_in too
+      *wi = -ray_in;
+      *pdf = bsdf.GetPdf(vertex.normal, wo, ray_in, vertex.front_face);
+      if (*pdf <= 0.0f) {
+        return false;
+      }
+      *weight = bsdf.GetBsdf(vertex.normal, wo, ray_in, vertex.front_face) *
+                glm::abs(glm::dot(vertex.normal, *wi)) / *pdf;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+float BdptIntegrator::GetPdf_(const Vertex &vertex,
+                              const Vertex *prev,
+                              const Vertex &next) const {
+  if (vertex.type == VERTEX_LIGHT) {
+    return GetLightPdf_(vertex, next);
+  }
+  glm::vec3 wo = glm::normalize(prev->position - vertex.position);
+  glm::vec3 wi = glm::normalize(next.position - vertex.position);
+  return ConvertDensity_(GetBsdfPdf_(vertex, wo, wi), vertex, next);
+}
+
+float BdptIntegrator::GetLightPdf_(const Vertex &light,
+                                   const Vertex &next) const {
+  glm::vec3 w = glm::normalize(next.position - light.position);
+  // Cosine weighted on a side picked at random
+  float pdf_dir = glm::abs(glm::dot(light.normal, w)) * INV_PI * 0.5f;
+  return ConvertDensity_(pdf_dir, light, next);
+}
+
+float BdptIntegrator::GetLightOriginPdf_(const Vertex &vertex) const {
+  if (vertex.light_index < 0) {
+    return 0.0f;
+  }
+  return scene_->GetLights().GetPdf(vertex.light_index);
+}
+
+float BdptIntegrator::ConvertDensity_(float pdf,
+                                      const Vertex &from,
+                                      const Vertex &to) {
+  glm::vec3 d = to.position - from.position;
+  float dist2 = glm::dot(d, d);
+  if (dist2 <= 0.0f) {
+    return 0.0f;
+  }
+  float density = pdf / dist2;
+  if (to.type != VERTEX_CAMERA) { // The camera is a point
+    density *= glm::abs(glm::dot(to.normal, d)) / glm::sqrt(dist2);
+  }
+  return density;
+}
+}  // namespace sparks
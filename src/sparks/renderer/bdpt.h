@@ -0,0 +1,109 @@
+#pragma once
+#include "sparks/renderer/path_tracer.h"
+#include "sparks/renderer/renderer_settings.h"
+#include "sparks/util/sampler.h"
+#include "vector"
+
+namespace sparks {
+/* @brief Bidirectional path tracer (Veach 1997). Each sample traces a camera
+* subpath and a light subpath, connects every prefix of one to every prefix
+* of the other and weights the strategies by the balance heuristic. Light
+* coming through narrow gaps or glass, which camera paths seldom find, is
+* reached from the light side.
+* Strategies with a single camera vertex would splat into other pixels, and
+* other tiles, so they are left out. The weights of the others still sum to
+* one. Lights emit the same radiance in every direction. They emit on both
+* sides, as in PathTracer whether hit or sampled. The envmap is only reached
+* by camera subpaths.
+*/
+class BdptIntegrator {
+ public:
+  explicit BdptIntegrator(const RendererSettings *render_settings);
+
+  void SetScene(const Scene *scene);
+  [[nodiscard]] const Scene *GetScene() const {
+    return scene_;
+  }
+  // Started by Renderer::GeneratePrimaryRay for each sample
+  [[nodiscard]] Sampler &GetSampler() {
+    return path_tracer_.GetSampler();
+  }
+
+  // Radiance along a camera ray
+  [[nodiscard]] glm::vec3 SampleRay(const glm::vec3 &origin,
+                                    const glm::vec3 &direction,
+                                    float time);
+
+ private:
+  enum VertexType { VERTEX_CAMERA, VERTEX_LIGHT, VERTEX_SURFACE };
+  struct Vertex {
+    VertexType type{VERTEX_SURFACE};
+    glm::vec3 position{0.0f};
+    glm::vec3 normal{0.0f}; // Shading normal, or of the light
+    glm::vec3 beta{1.0f};   // Throughput of the subpath up to this vertex
+    glm::vec3 color{0.0f};  // Albedo of a surface
+    glm::vec3 emission{0.0f};
+    const Entity *entity{nullptr};
+    int light_index{-1}; // Of a light, or of an emitter that is a light
+    bool front_face{true};
+    bool delta{false}; // Scattered by a specular material
+    // Densities of reaching this vertex from either subpath, with respect to area
+    float pdf_fwd{0.0f};
+    float pdf_rev{0.0f};
+  };
+
+  const RendererSettings *render_settings_{};
+  const Scene *scene_{};
+  PathTracer path_tracer_; // Shading normals and the sampler
+  float time_{0.0f};
+  std::vector<Vertex> camera_path_;
+  std::vector<Vertex> light_path_;
+
+  // Scattering vertices of the longest path, as PathTracer bounds them
+  [[nodiscard]] int GetMaxDepth_() const;
+  /* @brief Extend path, whose last vertex shot a ray, until it ends
+  * @param pdf, of the ray with respect to solid angle
+  * @param radiance, receives the envmap if the ray escapes. nullptr for light subpaths
+  */
+  void RandomWalk_(glm::vec3 direction,
+                   glm::vec3 beta,
+                   float pdf,
+                   int max_vertices,
+                   std::vector<Vertex> *path,
+                   glm::vec3 *radiance);
+  void TraceLightPath_();
+  // Light vertex on a point sampled from the lights, for s = 1
+  bool SampleLightVertex_(Vertex *vertex);
+  // Contribution of the strategy of s light and t camera vertices
+  glm::vec3 Connect_(int s, int t);
+  [[nodiscard]] float MisWeight_(int s, int t, const Vertex &sampled) const;
+  // Whether nothing lies between a and b
+  [[nodiscard]] bool Unoccluded_(const Vertex &a, const Vertex &b) const;
+
+  // wo and wi point away from the vertex
+  [[nodiscard]] glm::vec3 EvaluateBsdf_(const Vertex &vertex,
+                                        const glm::vec3 &wo,
+                                        const glm::vec3 &wi) const;
+  [[nodiscard]] float GetBsdfPdf_(const Vertex &vertex,
+                                  const glm::vec3 &wo,
+                                  const glm::vec3 &wi) const;
+  // @return false if the path ends. *weight is f * cos / pdf
+  bool SampleBsdf_(const Vertex &vertex,
+                   const glm::vec3 &wo,
+                   glm::vec3 *wi,
+                   glm::vec3 *weight,
+                   float *pdf);
+
+  // Density at next of vertex scattering, or emitting, toward it
+  [[nodiscard]] float GetPdf_(const Vertex &vertex,
+                              const Vertex *prev,
+                              const Vertex &next) const;
+  [[nodiscard]] float GetLightPdf_(const Vertex &light,
+                                   const Vertex &next) const;
+  // Density of a light subpath starting at vertex
+  [[nodiscard]] float GetLightOriginPdf_(const Vertex &vertex) const;
+  [[nodiscard]] static float ConvertDensity_(float pdf,
+                                             const Vertex &from,
+                                             const Vertex &to);
+};
+}  // namespace sparks
@@ -0,0 +1,114 @@
+#include "sparks/renderer/checkpoint.h"
+
+#include "cstring"
+#include "filesystem"
+#include "fstream"
+#include "sparks/util/util.h"
+
+namespace sparks {
+
+namespace {
+constexpr char kCheckpointMagic[4] = {'S', 'P', 'K', 'C'};
+constexpr uint32_t kCheckpointVersion = 2;
+
+struct CheckpointHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t num_tasks;
+  uint32_t num_retry_tasks;
+};
+}  // namespace
+
+bool WriteCheckpoint(const Checkpoint &checkpoint, const std::string &path) {
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      LAND_WARN("Checkpoint: cannot open {}", temp_path);
+      return false;
+    }
+    CheckpointHeader header{};
+    std::memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+    header.version = kCheckpointVersion;
+    header.width = checkpoint.width;
+    header.height = checkpoint.height;
+    header.num_tasks = uint32_t(checkpoint.tasks.size());
+    header.num_retry_tasks = uint32_t(checkpoint.retry_tasks.size());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(checkpoint.tasks.data()),
+               std::streamsize(sizeof(TaskInfo) * checkpoint.tasks.size()));
+    file.write(
+        reinterpret_cast<const char *>(checkpoint.retry_tasks.data()),
+        std::streamsize(sizeof(TaskInfo) * checkpoint.retry_tasks.size()));
+    file.write(
+        reinterpret_cast<const char *>(checkpoint.accumulation_color.data()),
+        std::streamsize(sizeof(glm::vec4) *
+                        checkpoint.accumulation_color.size()));
+    file.write(
+        reinterpret_cast<const char *>(checkpoint.accumulation_number.data()),
+        std::streamsize(sizeof(float) * checkpoint.accumulation_number.size()));
+    if (!file) {
+      LAND_WARN("Checkpoint: failed to write {}", temp_path);
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    LAND_WARN("Checkpoint: cannot move {} to {}: {}", temp_path, path,
+              error.message());
+    return false;
+  }
+  return true;
+}
+
+bool ReadCheckpoint(const std::string &path, Checkpoint &checkpoint) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    LAND_WARN("Checkpoint: cannot open {}", path);
+    return false;
+  }
+  CheckpointHeader header{};
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file ||
+      std::memcmp(header.magic, kCheckpointMagic, sizeof(header.magic)) ||
+      header.version != kCheckpointVersion) {
+    LAND_WARN("Checkpoint: {} is not a checkpoint of this version", path);
+    return false;
+  }
+  checkpoint.width = header.width;
+  checkpoint.height = header.height;
+  checkpoint.tasks.resize(header.num_tasks);
+  checkpoint.retry_tasks.resize(header.num_retry_tasks);
+  checkpoint.accumulation_color.resize(size_t(header.width) * header.height);
+  checkpoint.accumulation_number.resize(size_t(header.width) * header.height);
+  file.read(reinterpret_cast<char *>(checkpoint.tasks.data()),
+            std::streamsize(sizeof(TaskInfo) * checkpoint.tasks.size()));
+  file.read(reinterpret_cast<char *>(checkpoint.retry_tasks.data()),
+            std::streamsize(sizeof(TaskInfo) *
+                            checkpoint.retry_tasks.size()));
+  file.read(reinterpret_cast<char *>(checkpoint.accumulation_color.data()),
+            std::streamsize(sizeof(glm::vec4) *
+                            checkpoint.accumulation_color.size()));
+  file.read(reinterpret_cast<char *>(checkpoint.accumulation_number.data()),
+            std::streamsize(sizeof(float) *
+                            checkpoint.accumulation_number.size()));
+  if (!file) {
+    LAND_WARN("Checkpoint: {} is truncated", path);
+    return false;
+  }
+  std::vector<TaskInfo> all_tasks = checkpoint.tasks;
+  all_tasks.insert(all_tasks.end(), checkpoint.retry_tasks.begin(),
+                   checkpoint.retry_tasks.end());
+  for (auto &task : all_tasks) {
+    if (task.x + task.width > header.width ||
+        task.y + task.height > header.height) {
+      LAND_WARN("Checkpoint: {} has a tile outside the image", path);
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace sparks
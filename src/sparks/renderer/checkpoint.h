@@ -0,0 +1,30 @@
+#pragma once
+#include "cstdint"
+#include "glm/glm.hpp"
+#include "sparks/renderer/util.h"
+#include "string"
+#include "vector"
+
+namespace sparks {
+/* @brief Rendering state needed to continue an accumulation.
+* Random numbers are seeded from (x, y, sample) only, so the sample counters
+* of the tiles are the complete RNG progress.
+*/
+struct Checkpoint {
+  uint32_t width{0};
+  uint32_t height{0};
+  std::vector<TaskInfo> tasks; // Queued tiles, none in flight
+  std::vector<TaskInfo> retry_tasks; // Cancelled tiles, rendered once more
+  std::vector<glm::vec4> accumulation_color;
+  std::vector<float> accumulation_number;
+};
+
+/* @brief Write a checkpoint to a binary file. The file is written next to
+* path first and then renamed, so an interrupted write keeps the old one.
+* @return false on IO error
+*/
+bool WriteCheckpoint(const Checkpoint &checkpoint, const std::string &path);
+
+// Read a checkpoint. Return false if the file is missing or malformed
+bool ReadCheckpoint(const std::string &path, Checkpoint &checkpoint);
+}  // namespace sparks
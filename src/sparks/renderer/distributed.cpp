@@ -0,0 +1,350 @@
+#include "sparks/renderer/distributed.h"
+
+#include "algorithm"
+#include "cerrno"
+#include "chrono"
+#include "cstring"
+#include "sparks/renderer/renderer.h"
+#include "sparks/util/util.h"
+
+#if !defined(_WIN32)
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace sparks {
+
+namespace {
+constexpr uint32_t kDistributedMagic = 0x53504b44;  // "SPKD"
+
+// Sent by the coordinator right after a worker connected
+struct PartitionMessage {
+  uint32_t magic;
+  uint32_t partition_index;
+  uint32_t partition_count;
+  uint32_t width;
+  uint32_t height;
+  // Local spp of the partition, so that global samples end at the target
+  uint32_t samples;
+};
+
+// Sent by a worker, followed by its color and number buffers. Only the final
+// one, sent once the partition is complete, is merged into the result
+struct FrameMessage {
+  uint32_t magic;
+  uint32_t samples; // Samples every pixel of the frame has
+  uint32_t width;
+  uint32_t height;
+  uint32_t final;
+};
+
+#if !defined(_WIN32)
+bool SendAll(int socket_fd, const void *data, size_t size) {
+  auto bytes = static_cast<const char *>(data);
+  while (size) {
+    int flags = 0;
+#if defined(MSG_NOSIGNAL)
+    flags = MSG_NOSIGNAL; // A closed coordinator is not an error
+#endif
+    ssize_t sent = send(socket_fd, bytes, size, flags);
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    size -= size_t(sent);
+  }
+  return true;
+}
+
+bool ReceiveAll(int socket_fd, void *data, size_t size) {
+  auto bytes = static_cast<char *>(data);
+  while (size) {
+    ssize_t received = recv(socket_fd, bytes, size, 0);
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= size_t(received);
+  }
+  return true;
+}
+
+// Latest frame received from a worker, previewed until it is final
+struct WorkerFrame {
+  int socket_fd{-1};
+  uint32_t samples{0};
+  bool final{false};
+  std::vector<glm::vec4> color;
+  std::vector<float> number;
+};
+#endif
+}  // namespace
+
+#if defined(_WIN32)
+bool RunRenderCoordinator(uint16_t port,
+                          uint32_t num_workers,
+                          uint32_t width,
+                          uint32_t height,
+                          uint32_t target_samples,
+                          std::vector<glm::vec4> &result,
+                          const DistributedPreview &preview) {
+  LAND_ERROR("Distributed rendering is not supported on this platform.");
+  return false;
+}
+
+bool RunRenderWorker(Renderer *renderer,
+                     const std::string &host,
+                     uint16_t port,
+                     float stream_interval) {
+  LAND_ERROR("Distributed rendering is not supported on this platform.");
+  return false;
+}
+#else
+bool RunRenderCoordinator(uint16_t port,
+                          uint32_t num_workers,
+                          uint32_t width,
+                          uint32_t height,
+                          uint32_t target_samples,
+                          std::vector<glm::vec4> &result,
+                          const DistributedPreview &preview) {
+  int listen_fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    LAND_ERROR("Coordinator: cannot create socket.");
+    return false;
+  }
+  int enable = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  int disable = 0; // Accept IPv4 clients as well
+  setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+  sockaddr_in6 address{};
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons(port);
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listen_fd, int(num_workers)) < 0) {
+    LAND_ERROR("Coordinator: cannot listen on port {}.", port);
+    close(listen_fd);
+    return false;
+  }
+  LAND_INFO("Coordinator: waiting for {} workers on port {}.", num_workers,
+            port);
+
+  std::vector<WorkerFrame> workers(num_workers);
+  bool success = true;
+  for (uint32_t i = 0; i < num_workers && success; i++) {
+    workers[i].socket_fd = accept(listen_fd, nullptr, nullptr);
+    if (workers[i].socket_fd < 0) {
+      LAND_ERROR("Coordinator: cannot accept worker {}: {}.", i,
+                 std::strerror(errno));
+      success = false;
+      break;
+    }
+    // Global samples i, i + count, ... below target_samples
+    uint32_t samples =
+        target_samples > i ? (target_samples - i + num_workers - 1) / num_workers
+                           : 0;
+    PartitionMessage partition{kDistributedMagic, i, num_workers, width,
+                               height, samples};
+    if (!SendAll(workers[i].socket_fd, &partition, sizeof(partition))) {
+      LAND_ERROR("Coordinator: cannot send the partition of worker {}: {}.", i,
+                 std::strerror(errno));
+      success = false;
+      break;
+    }
+    LAND_INFO("Coordinator: worker {} connected.", i);
+  }
+  close(listen_fd);
+  if (!success) {
+    // Workers already accepted see the connection close and stop
+    for (auto &worker : workers) {
+      if (worker.socket_fd >= 0) {
+        close(worker.socket_fd);
+      }
+    }
+    return false;
+  }
+
+  size_t num_pixels = size_t(width) * height;
+  uint32_t total_samples = 0;
+  uint32_t num_final = 0;
+  auto last_report = std::chrono::steady_clock::now();
+  while (success && num_final < num_workers) {
+    // Workers that sent their final buffers are done
+    std::vector<pollfd> poll_fds;
+    std::vector<size_t> poll_workers;
+    for (size_t i = 0; i < workers.size(); i++) {
+      if (!workers[i].final) {
+        poll_fds.push_back({workers[i].socket_fd, POLLIN, 0});
+        poll_workers.push_back(i);
+      }
+    }
+    if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+      success = false;
+      break;
+    }
+    for (size_t k = 0; k < poll_fds.size(); k++) {
+      if (!(poll_fds[k].revents & (POLLIN | POLLHUP | POLLERR))) {
+        continue;
+      }
+      size_t i = poll_workers[k];
+      auto &worker = workers[i];
+      FrameMessage frame{};
+      worker.color.resize(num_pixels);
+      worker.number.resize(num_pixels);
+      // Each frame overwrites the previous one of the worker
+      bool received = ReceiveAll(worker.socket_fd, &frame, sizeof(frame)) &&
+                      frame.magic == kDistributedMagic &&
+                      frame.width == width && frame.height == height &&
+                      ReceiveAll(worker.socket_fd, worker.color.data(),
+                                 sizeof(glm::vec4) * num_pixels) &&
+                      ReceiveAll(worker.socket_fd, worker.number.data(),
+                                 sizeof(float) * num_pixels);
+      if (!received) {
+        LAND_ERROR("Coordinator: lost worker {}.", i);
+        success = false;
+        break;
+      }
+      worker.samples = frame.samples;
+      if (frame.final) {
+        worker.final = true;
+        num_final++;
+      }
+    }
+    total_samples = 0;
+    for (auto &worker : workers) {
+      total_samples += worker.samples;
+    }
+    if (success && num_final < num_workers &&
+        std::chrono::steady_clock::now() - last_report >
+            std::chrono::seconds(5)) {
+      LAND_INFO("Coordinator: {}/{} spp.", total_samples, target_samples);
+      if (preview) {
+        std::vector<glm::vec4> color(num_pixels, glm::vec4{0.0f});
+        std::vector<float> number(num_pixels, 0.0f);
+        for (auto &worker : workers) {
+          for (size_t i = 0; i < worker.number.size(); i++) {
+            color[i] += worker.color[i];
+            number[i] += worker.number[i];
+          }
+        }
+        preview(color, number, total_samples);
+      }
+      last_report = std::chrono::steady_clock::now();
+    }
+  }
+  // Closing the connections tells the workers still rendering to stop
+  for (auto &worker : workers) {
+    if (worker.socket_fd >= 0) {
+      close(worker.socket_fd);
+    }
+  }
+  if (!success) {
+    return false;
+  }
+
+  result.assign(num_pixels, glm::vec4{0.0f});
+  for (size_t i = 0; i < num_pixels; i++) {
+    glm::vec4 color{0.0f};
+    float number = 0.0f;
+    for (auto &worker : workers) {
+      color += worker.color[i];
+      number += worker.number[i];
+    }
+    result[i] = color / std::max(1.0f, number);
+  }
+  LAND_INFO("Coordinator: merged {} spp from {} workers.", total_samples,
+            num_workers);
+  return true;
+}
+
+bool RunRenderWorker(Renderer *renderer,
+                     const std::string &host,
+                     uint16_t port,
+                     float stream_interval) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                  &addresses) != 0) {
+    LAND_ERROR("Worker: cannot resolve {}.", host);
+    return false;
+  }
+  int socket_fd = -1;
+  for (auto address = addresses; address; address = address->ai_next) {
+    socket_fd =
+        socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (socket_fd >= 0 &&
+        connect(socket_fd, address->ai_addr, address->ai_addrlen) == 0) {
+      break;
+    }
+    if (socket_fd >= 0) {
+      close(socket_fd);
+      socket_fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  PartitionMessage partition{};
+  if (socket_fd < 0 || !ReceiveAll(socket_fd, &partition, sizeof(partition)) ||
+      partition.magic != kDistributedMagic) {
+    LAND_ERROR("Worker: cannot reach coordinator {}:{}.", host, port);
+    if (socket_fd >= 0) {
+      close(socket_fd);
+    }
+    return false;
+  }
+  LAND_INFO("Worker: rendering sample partition {}/{} at {}x{}.",
+            partition.partition_index, partition.partition_count,
+            partition.width, partition.height);
+
+  // With more workers than spp, a partition can be empty
+  bool render = partition.samples > 0;
+  auto &settings = renderer->GetRendererSettings();
+  settings.sample_partition_index = partition.partition_index;
+  settings.sample_partition_count = partition.partition_count;
+  settings.sample_target = partition.samples;
+  if (render) {
+    renderer->StartWorkerThreads();
+    renderer->Resize(partition.width, partition.height);
+  }
+
+  size_t num_pixels = size_t(partition.width) * partition.height;
+  std::vector<glm::vec4> color(num_pixels);
+  std::vector<float> number(num_pixels);
+  auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::duration<float>(std::max(stream_interval, 0.1f)));
+  bool success = true;
+  bool final = false;
+  while (success && !final) {
+    // A time budget can end the partition short of its spp. The buffers
+    // still hold the same samples in every pixel
+    final = !render || renderer->WaitForSampleTarget(interval) ||
+            renderer->IsBudgetExhausted();
+    FrameMessage frame{kDistributedMagic,
+                       render ? uint32_t(renderer->GetAccumulatedSamples()) : 0,
+                       partition.width, partition.height, final};
+    if (render) {
+      renderer->RetrieveAccumulationResult(color.data(), number.data());
+    }
+    success = SendAll(socket_fd, &frame, sizeof(frame)) &&
+              SendAll(socket_fd, color.data(), sizeof(glm::vec4) * num_pixels) &&
+              SendAll(socket_fd, number.data(), sizeof(float) * num_pixels);
+  }
+  close(socket_fd);
+  if (render) {
+    renderer->StopWorkers();
+  }
+  if (!success) {
+    LAND_ERROR("Worker: lost the coordinator.");
+    return false;
+  }
+  LAND_INFO("Worker: finished {} spp.", partition.samples);
+  return true;
+}
+#endif
+}  // namespace sparks
@@ -0,0 +1,51 @@
+#pragma once
+#include "cstdint"
+#include "functional"
+#include "glm/glm.hpp"
+#include "string"
+#include "vector"
+
+namespace sparks {
+class Renderer;
+
+/* Multi-process rendering over TCP. Each worker process renders every pixel
+* with an interleaved partition of the samples, global sample
+* local_sample * count + index, up to its share of the target spp. It
+* streams its accumulation buffers to the coordinator, which merges the latest
+* buffers of every worker for previews, and the final buffers, sent once a
+* worker has its share, for the result. As rays are seeded by
+* (x, y, global sample) only, the result has exactly the target samples and
+* does not depend on the number of workers or their timing.
+*/
+
+// Summed colors and sample counts of each pixel over the latest worker
+// buffers, and the samples every pixel has at least
+using DistributedPreview =
+    std::function<void(const std::vector<glm::vec4> &color,
+                       const std::vector<float> &number,
+                       uint32_t samples)>;
+
+/* @brief Wait for num_workers workers, assign their sample partitions and
+* merge their final accumulation buffers, target_samples spp in total.
+* @param result merged radiance of each pixel
+* @param preview called with the partial merge every few seconds, if set
+* @return false on network error
+*/
+bool RunRenderCoordinator(uint16_t port,
+                          uint32_t num_workers,
+                          uint32_t width,
+                          uint32_t height,
+                          uint32_t target_samples,
+                          std::vector<glm::vec4> &result,
+                          const DistributedPreview &preview = {});
+
+/* @brief Connect to a coordinator, render the assigned partition and send the
+* accumulation every stream_interval seconds, then once more when complete.
+* The worker threads of the renderer are started and stopped here.
+* @return false if the coordinator can not be reached
+*/
+bool RunRenderWorker(Renderer *renderer,
+                     const std::string &host,
+                     uint16_t port,
+                     float stream_interval);
+}  // namespace sparks
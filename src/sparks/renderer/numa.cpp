@@ -0,0 +1,119 @@
+#include "sparks/renderer/numa.h"
+
+#include "algorithm"
+#include "fstream"
+#include "sstream"
+#include "string"
+#include "thread"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace sparks {
+
+namespace {
+std::vector<NumaNode> SingleNodeTopology() {
+  NumaNode node;
+  uint32_t num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+  for (int i = 0; i < int(num_cpus); i++) {
+    node.cpus.push_back(i);
+  }
+  return {node};
+}
+
+#if defined(__linux__)
+// Parse a sysfs cpu list such as "0-7,16-23"
+std::vector<int> ParseCpuList(const std::string &cpu_list) {
+  std::vector<int> cpus;
+  std::stringstream stream(cpu_list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+#endif
+}  // namespace
+
+std::vector<NumaNode> QueryNumaTopology() {
+  std::vector<NumaNode> nodes;
+#if defined(__linux__)
+  for (int id = 0;; id++) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) +
+                       "/cpulist");
+    if (!file) {
+      break;
+    }
+    std::string cpu_list;
+    std::getline(file, cpu_list);
+    NumaNode node;
+    node.id = id;
+    node.cpus = ParseCpuList(cpu_list);
+    if (!node.cpus.empty()) { // memory-only nodes have no cpus
+      nodes.push_back(node);
+    }
+  }
+#elif defined(_WIN32)
+  ULONG highest_node = 0;
+  if (GetNumaHighestNodeNumber(&highest_node)) {
+    for (ULONG id = 0; id <= highest_node; id++) {
+      ULONGLONG mask = 0;
+      if (!GetNumaNodeProcessorMask(UCHAR(id), &mask) || mask == 0) {
+        continue;
+      }
+      NumaNode node;
+      node.id = int(id);
+      for (int cpu = 0; cpu < 64; cpu++) {
+        if (mask & (1ull << cpu)) {
+          node.cpus.push_back(cpu);
+        }
+      }
+      nodes.push_back(node);
+    }
+  }
+#endif
+  if (nodes.empty()) {
+    return SingleNodeTopology();
+  }
+  return nodes;
+}
+
+bool PinCurrentThreadToCpus(const std::vector<int> &cpus) {
+  if (cpus.empty()) {
+    return false;
+  }
+#if defined(__linux__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &cpu_set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) ==
+         0;
+#elif defined(_WIN32)
+  DWORD_PTR mask = 0;
+  for (int cpu : cpus) {
+    if (cpu < int(sizeof(DWORD_PTR) * 8)) {
+      mask |= DWORD_PTR(1) << cpu;
+    }
+  }
+  return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  return false;
+#endif
+}
+}  // namespace sparks
@@ -0,0 +1,45 @@
+#pragma once
+#include "cstdint"
+#include "memory"
+#include "vector"
+
+namespace sparks {
+// A NUMA node and the logical cpus that belong to it
+struct NumaNode {
+  int id{0};
+  std::vector<int> cpus;
+};
+
+/* @brief Query the NUMA topology of this machine.
+* @return one entry per node. If the topology is unavailable, a single node
+* holding every logical cpu is returned.
+*/
+std::vector<NumaNode> QueryNumaTopology();
+
+// Restrict the calling thread to the given logical cpus. Return false on failure
+bool PinCurrentThreadToCpus(const std::vector<int> &cpus);
+
+/* @brief Allocator that leaves trivially constructible elements untouched on
+* resize, so the pages of a buffer are first touched (and thus placed) by the
+* thread that writes to them first instead of by the allocating thread.
+*/
+template <class T>
+struct DefaultInitAllocator : std::allocator<T> {
+  template <class U>
+  struct rebind {
+    using other = DefaultInitAllocator<U>;
+  };
+  DefaultInitAllocator() = default;
+  template <class U>
+  DefaultInitAllocator(const DefaultInitAllocator<U> &) noexcept {
+  }
+  template <class U>
+  void construct(U *ptr) {
+    ::new (static_cast<void *>(ptr)) U;
+  }
+  template <class U, class... Args>
+  void construct(U *ptr, Args &&...args) {
+    ::new (static_cast<void *>(ptr)) U(std::forward<Args>(args)...);
+  }
+};
+}  // namespace sparks
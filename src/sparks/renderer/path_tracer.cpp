@@ -1,5 +1,6 @@
 #include "sparks/renderer/path_tracer.h"
 
+#include "sparks/util/check.h"
 #include "sparks/util/util.h"
 #include "sparks/util/sample.h"
 #include <glm/gtx/string_cast.hpp>
@@ -8,12 +9,13 @@ namespace sparks {
 PathTracer::PathTracer(const RendererSettings *render_settings,
                        const Scene *scene,
                        unsigned int seed):
-  rng_{seed}, bounce_cnt_{ 0 } {
+  sampler_{render_settings->sampler, render_settings->blue_noise} {
   render_settings_ = render_settings;
   scene_ = scene;
+  sampler_.StartSample(0, 0, seed);
 }
 PathTracer::PathTracer(const RendererSettings* render_settings, const Scene* scene):
-  rng_{std::random_device()()}, bounce_cnt_ {0}
+  sampler_{render_settings->sampler, render_settings->blue_noise}
 {
   render_settings_ = render_settings;
   scene_ = scene;
@@ -29,7 +31,7 @@ glm::vec3 PathTracer::SampleRay(glm::vec3 origin,
   glm::vec3 radiance{0.0f};
   HitRecord hit_record;
   const int max_bounce = render_settings_->num_bounces;
-  std::mt19937 rd(sample ^ x ^ y);
+  Rng rd(GetSampleSeed(x, y, sample));
   float time = 0.0f;
   for (int i = 0; i < max_bounce; i++) {
     auto t = scene_->TraceRay(origin, direction, time, 1e-3f, 1e4f, &hit_record);
@@ -69,230 +71,76 @@ glm::vec3 PathTracer::SampleRay(glm::vec3 origin,
 glm::vec3 PathTracer::SampleRayPathTrace(glm::vec3 origin,
                                          glm::vec3 direction,
                                          float time){
-  //LAND_INFO("Path trace starts {}, {}", glm::to_string(origin), glm::to_string(direction));
-  bounce_cnt_ = 0; // clear bounce_cnt_
+  glm::vec3 radiance{ 0.0f };
+  glm::vec3 throughput{ 1.0f };
   HitRecord hit_record;
-  // Find intersection
-  auto t = scene_->TraceRay(origin, direction, time, 1e-3f, 1e4f, &hit_record);
-  //auto t = scene_->TraceRay(origin, direction, 1e-3f, 1e4f, &hit_record);
-  //LAND_INFO("Finished ray tracing");
-  if (t <= 0.0f) { // No intersection
-    //return glm::vec3{scene_->SampleEnvmap(direction)}; // Check this
-    return glm::vec3{ 0.0f };
+  HitRecord shadow_record;
+  PathScatter scatter = GetCameraScatter();
+  // Two rays per bounce: one BSDF sample both continues the path and finds the
+  // lights for MIS, next to the light ray of next event estimation
+  for (int bounce = 0;; bounce++) {
+    float t = scene_->TraceRay(origin, direction, time, 1e-3f, 1e4f, &hit_record);
+    if (scatter.count_emission) {
+      radiance += throughput * ResolveEmission(scatter, direction, t, hit_record);
+    }
+    if (t <= 0.0f || scatter.next_emission_only) {
+      break;
+    }
+    throughput *= scatter.next_rr_scale;
+    Scatter(hit_record, -direction, bounce, throughput, sampler_, &scatter);
+    glm::vec3 p = hit_record.position;
+    if (scatter.has_light_ray) {
+      float t_light = scene_->TraceRay(p, scatter.light_direction, time, 1e-3f, 1e4f, &shadow_record);
+      radiance += throughput * ResolveLightRay(scatter, t_light, shadow_record);
+    }
+    if (!scatter.has_next_ray) {
+      break;
+    }
+    throughput *= scatter.next_weight;
+    origin = p;
+    direction = scatter.next_direction;
   }
-  // Has intersection
-  auto shade_p = hit_record.position; // The position to shade
-  glm::vec3 shade_dir = -direction; // The direction to shade
-
-  // Test whether the intersection is light source
-  auto& material =
-      scene_->GetEntity(hit_record.hit_entity_id).GetMaterial(); // The hit object is stored in hit_record
-
-  //auto normal = hit_record.normal;
-  //if (material->material_type == MATERIAL_TYPE_EMISSION) { // light source, return directly
-  //    return material->emission * material->emission_strength;
-    
-  // Not light source
-  glm::vec3 color = Shade_(hit_record, shade_dir, time);
-  color.x = clamp(color.x, 0.0f, render_settings_->max_color);
-  color.y = clamp(color.y, 0.0f, render_settings_->max_color);
-  color.z = clamp(color.z, 0.0f, render_settings_->max_color);
-  return color;
-  //return glm::vec3{};
+  radiance.x = clamp(radiance.x, 0.0f, render_settings_->max_color);
+  radiance.y = clamp(radiance.y, 0.0f, render_settings_->max_color);
+  radiance.z = clamp(radiance.z, 0.0f, render_settings_->max_color);
+  return radiance;
 }
 
-glm::vec3 PathTracer::Shade_(const HitRecord& hit_record, const glm::vec3& dir_out, float time){
-  const Material& material = scene_->GetEntity(hit_record.hit_entity_id).GetMaterial(); // material
-  glm::vec3 p = hit_record.position; // position to shade
-  //LAND_INFO("Bounce {}; position {}; in direction {}", bounce_cnt_, glm::to_string(p), glm::to_string(-dir_out) );
-  // Get color according to texture
-  //LAND_INFO("Texture coord {}", glm::to_string(hit_record.tex_coord));
-  glm::vec3 hit_color = glm::vec3{ scene_->GetTextures()[material.albedo_texture_id].Sample(
-                hit_record.tex_coord) } * material.albedo_color;
-  glm::vec3 normal;
-  //LAND_INFO("normal texture id {}", material.normal_texture_id);
+glm::vec3 PathTracer::GetShadingNormal(const HitRecord& hit_record, const Material& material) const {
   if (material.normal_texture_id == 1) { // default normal
-    normal = hit_record.normal; // normal or geometry normal?
+    return GetShadingNormal_<false>(hit_record, material);
+  }
+  return GetShadingNormal_<true>(hit_record, material);
+}
+
+template <bool kNormalMap>
+glm::vec3 PathTracer::GetShadingNormal_(const HitRecord& hit_record, const Material& material) const {
+  if constexpr (!kNormalMap) {
+    return hit_record.normal; // normal or geometry normal?
   }
   else {
     auto& tangent_space_normal = glm::vec3{ scene_->GetTextures()[material.normal_texture_id].Sample(
                 hit_record.tex_coord) };
-    //LAND_INFO("Normal texture id {}. Get tangent space normal {}", material.normal_texture_id, glm::to_string(tangent_space_normal));
     tangent_space_normal = tangent_space_normal * 2.0f - 1.0f; // convert to [-1,1]
-    //LAND_INFO("Tangent space normal {}", glm::to_string(tangent_space_normal));
     // Compute TBN in model space
-    if (glm::length(hit_record.tangent) < 1e-5) {
-      LAND_ERROR("Hit record tangent is 0!");
-    }
+    SPARKS_CHECK(glm::dot(hit_record.tangent, hit_record.tangent) >= 1e-10f, "Hit record tangent is 0");
     auto& bitangent = glm::cross(hit_record.normal, hit_record.tangent);
     glm::mat3 TBN{ hit_record.tangent, bitangent, hit_record.normal };
-    //LAND_INFO("Get TBN matrix {}", glm::to_string(TBN));
-    normal = glm::normalize(TBN * tangent_space_normal);
+    glm::vec3 normal = glm::normalize(TBN * tangent_space_normal);
     if (glm::dot(normal, hit_record.normal) < 0) { // Correct direction
       normal = -normal;
     }
-   
-  }
-  if (glm::abs(glm::length(normal) - 1.0f) > 1e-5f) {
-    LAND_ERROR("Unnormalized normal! {}", glm::to_string(normal));
-  }
-  if (material.material_type == MATERIAL_TYPE_EMISSION) { // emission
-    //LAND_INFO("Material emission");
-    // We may consider diffuse/specular light in principled BSDF
-    //if (bounce_cnt_ >= 1) {
-    //  LAND_INFO("Bounce to emission! {}", bounce_cnt_);
-    //}
-    glm::vec3 color = ShadeEmission_(
-      dir_out,
-      normal,
-      material.emission,
-      material.emission_strength);
-    //LAND_INFO("Get emission light {}", glm::to_string(color));
-    //if (glm::any(glm::lessThan(color, glm::vec3{ 0.0f }))) {
-    //  LAND_INFO("Is front face {}", hit_record.front_face);
-    //  LAND_INFO("Geometry normal {}", glm::to_string(hit_record.geometry_normal));
-    //  LAND_INFO("Cosine {}", glm::dot(hit_record.normal, dir_out));
-    //  LAND_ERROR("Negative color {} at postion {} with normal {}", glm::to_string(color), glm::to_string(p), glm::to_string(hit_record.normal) );
-    //}
-    //if (color.x != color.y) {
-    //  LAND_WARN("Buggy color {}, emission {}", glm::to_string(color), glm::to_string(material.emission));
-    //}
-    return color;
-  } 
-  else if (material.material_type == MATERIAL_TYPE_LAMBERTIAN) { // diffuse
-    //LAND_INFO("Material diffuse");
-    return ShadeDiffuse_(
-      p,
-      dir_out,
-      hit_color,
-      normal,
-      time
-    );
-  }
-  else if (material.material_type == MATERIAL_TYPE_SPECULAR) { // specular
-    //LAND_INFO("Material specular");
-    //if (glm::abs(p.y - 330.0f) < 1e-3f) {
-    //  LAND_INFO("Specular bounce at tall block top! {}", glm::to_string(p));
-    //}
-    return ShadeSpecular_(
-      p,
-      dir_out,
-      normal,
-      hit_color,
-      time
-    );
-  }
-  else if (material.material_type == MATERIAL_TYPE_TRANSMISSIVE) { // transmissive
-    return ShadeTransmissive_(
-      p,
-      dir_out,
-      normal,
-      hit_color,
-      material.ior,
-      hit_record.front_face,
-      time
-    );
-  }
-  else if (material.material_type == MATERIAL_TYPE_PRINCIPLED) { // principled bsdf
-    return ShadeBsdf_(p, dir_out, normal, material, hit_record.front_face, time);
-  }
-  else {
-    LAND_ERROR("Unknown material type {}!", material.material_type);
-    throw "Error occurs!";
+    return normal;
   }
 }
 
-glm::vec3 PathTracer::ShadeDiffuse_(const glm::vec3& p, const glm::vec3& dir_out, const glm::vec3& albedo_color, const glm::vec3& normal, float time)
+float PathTracer::GetEnvmapLightProb_() const
 {
-  if (glm::abs(glm::length(normal) - 1.0f) > 1e-3f) { // Check if normalized
-    throw "Unnormalized normal!";
-  }
-  //if (glm::dot(dir_out, normal) < 0.0f) {
-  //  LAND_ERROR("Normal direction incorrect! Normal {}, out ray {}", glm::to_string(normal), glm::to_string(dir_out));
-  //}
-  //LAND_INFO("Normal correct at {}", glm::to_string(p));
-  // Compute direct light
-  glm::vec3 radiance_dir{ 0.0f };
-  // Sample light source, seed choice is unimportant
-  int sample_light_idx;
-  glm::vec3 sample_light_pos;
-  float pdf_light = scene_->GetLights().Sample(&sample_light_idx, &sample_light_pos, rng_);
-  const Light* sample_light = scene_->GetLights().GetLight(sample_light_idx);
-  // Test blocking to sampled light source
-  HitRecord hit_record;
-  glm::vec3 ray = sample_light_pos - p; // ray to light
-  //scene_->TraceRay(p, glm::normalize(ray), 1e-3f, 1e4f, &hit_record);
-  scene_->TraceRay(p, glm::normalize(ray), time, 1e-3f, 1e4f, &hit_record);
-  auto hit_normal = hit_record.normal; // normal of intersection
-  if (glm::abs(glm::length(hit_normal) - 1.0f) > 1e-3f) { // Check if normalized
-    throw "Unnormalized normal!";
-  }
-  if (glm::distance(hit_record.position, sample_light_pos) < 1e-3f && hit_record.front_face) { // No blocking
-   //  TODO: Complete direct light
-    //float cos_hit = glm::dot(normal, glm::normalize(ray));
-    //float cos_light = glm::dot(hit_normal, glm::normalize(-ray));
-    //if (cos_hit < 0.0f) {
-    //  cos_hit = 0.0f;
-    //}
-    //if (cos_light < 0.0f) {
-    //  cos_light = 0.0f;
-    //}
-    float cos_hit = glm::abs(glm::dot(normal, glm::normalize(ray)));
-    float cos_light = glm::abs(glm::dot(hit_normal, glm::normalize(-ray)));
-    //float cos_hit = 1.0f;
-    //float cos_light = 1.0f;
-    float square_dist = glm::dot(ray, ray); // squared distance from p to light
-    radiance_dir = sample_light->emission * sample_light->emission_strength
-      * albedo_color * sparks::INV_PI
-      * cos_hit * cos_light / square_dist / pdf_light;
-  }
-  //LAND_INFO("Get direct light {}", glm::to_string(radiance_dir));
-
-  // TODO: Complete indirect light
-  glm::vec3 radiance_indir{ 0.0f };
-  float sample_prob = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng_);
-  if (bounce_cnt_ < render_settings_->num_bounces 
-      && sample_prob < render_settings_->prob_rr) 
-  { // Bounce count did not reach limit and passed russian roulette
-    float pdf;
-    glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, rng_, &pdf); // Sampled incident ray, but pointing outward
-    //glm::vec3 ray_in_reverse = hemisphere_sample(normal, rng_);
-    //pdf = 0.5 * INV_PI;
-    HitRecord hit_record_ind;
-    //float dist = scene_->TraceRay(p, ray_in_reverse, 1e-3f, 1e4f, &hit_record_ind);
-    if (pdf > 0.0f) {
-      float dist = scene_->TraceRay(p, ray_in_reverse, time, 1e-3f, 1e4f, &hit_record_ind);
-      if (dist > 0.0f) { // hit
-        const Material& hit_material = scene_->GetEntity(hit_record_ind.hit_entity_id).GetMaterial();
-        if (hit_material.material_type != MATERIAL_TYPE_EMISSION) { // not emission
-          bounce_cnt_++;
-          //LAND_INFO("Diffuse bounce pos {}, dir {}, albedo {}", glm::to_string(p), glm::to_string(ray_in_reverse), glm::to_string(albedo_color));
-          glm::vec3 color = Shade_(hit_record_ind, -ray_in_reverse, time);
-          radiance_indir = color * (albedo_color * INV_PI)
-            * glm::abs(glm::dot(normal, ray_in_reverse)) / pdf / render_settings_->prob_rr;
-          //LAND_INFO("Get indirect light {}", glm::to_string(radiance_indir));
-        }
-      }
-      else {
-        //LAND_INFO("Diffuse bounce hit fail! pos {}, dir {}, albedo {}", glm::to_string(p), glm::to_string(ray_in_reverse), glm::to_string(albedo_color));
-      }
-    }
+  if (!scene_->HasEnvmapLight()) {
+    return 0.0f;
   }
-  else {
-    //LAND_INFO("Failed RR {}", sample_prob);
-  }
-  // Need ambient light?
-  //glm::vec3 ambient_color = albedo_color * scene_->GetEnvmapMinorColor();
-  glm::vec3 ambient_color{ 0.0f };
-  //LAND_INFO("Direct light {}, indirect light {}, ambient light {}", 
-  //  glm::to_string(radiance_dir), 
-  //  glm::to_string(radiance_indir), 
-  //  glm::to_string(ambient_color));
-  glm::vec3 total_color = radiance_dir + radiance_indir + ambient_color;
-  if (glm::any(glm::lessThan(total_color, glm::vec3{ 0.0f }))) {
-    LAND_WARN("Negative color {}, dir {}, indir {}", glm::to_string(total_color), glm::to_string(radiance_dir), glm::to_string(radiance_indir));
-  }
-  return total_color;
+  // Half of the samples, as pbrt does for infinite lights beside a light tree
+  return scene_->GetLights().GetLightCount() ? 0.5f : 1.0f;
 }
 
 glm::vec3 PathTracer::ShadeEmission_(const glm::vec3& dir_out, const glm::vec3& normal, const glm::vec3& emission, float emission_strength) const
@@ -300,283 +148,257 @@ glm::vec3 PathTracer::ShadeEmission_(const glm::vec3& dir_out, const glm::vec3&
   return emission * emission_strength * glm::dot(glm::normalize(dir_out), glm::normalize(normal));
 }
 
-glm::vec3 PathTracer::ShadeSpecular_(const glm::vec3& p, const glm::vec3& dir_out, const glm::vec3& normal, const glm::vec3& albedo_color, float time)
+PathScatter PathTracer::GetCameraScatter()
 {
-  if (glm::abs(glm::length(normal) - 1.0f) > 1e-3f) {
-    throw "Unnormalized normal!";
-  }
-  if (glm::abs(glm::length(dir_out) - 1.0f) > 1e-3f) {
-    throw "Unnormalized out ray!";
-  }
-  // If just reach limit, allow the ray to bounce back once, so it can get diffuse light or direct light
-  if (bounce_cnt_ >= render_settings_->num_bounces + 1) {
-    //LAND_WARN("Too many bounces {}", bounce_cnt_);
-    //return albedo_color * scene_->GetEnvmapMinorColor();
-    return glm::vec3{ 0.0f };
-  }
-  if (glm::dot(dir_out, normal) < 0.0f) {
-    LAND_ERROR("Normal direction incorrect! Normal {}, out ray {}", glm::to_string(normal), glm::to_string(dir_out));
-  }
-  glm::vec3 dir_in_reverse = glm::reflect(-dir_out, normal); // the reverse direction of incident light
-  HitRecord hit_record_ind;
-  float dist = scene_->TraceRay(p, dir_in_reverse, time, 1e-3f, 1e4f, &hit_record_ind);
-  if (dist > 0.0f) { // hit
-    bounce_cnt_++;
-    //LAND_INFO("Specular, p {}, in ray {}, out ray {}, next point {}",
-    //  glm::to_string(p),
-    //  glm::to_string(-dir_out),
-    //  glm::to_string(dir_in_reverse),
-    //  glm::to_string(hit_record_ind.position));
-    return albedo_color * Shade_(hit_record_ind, -dir_in_reverse, time);
-  }
-  else {
-    //return albedo_color * scene_->GetEnvmapMinorColor();
-    return glm::vec3{ 0.0f };
-  }
+  PathScatter scatter;
+  scatter.count_emission = true;
+  return scatter;
 }
 
-glm::vec3 PathTracer::ShadeTransmissive_(const glm::vec3& p, const glm::vec3& dir_out, const glm::vec3& normal, const glm::vec3& albedo_color, float ior, bool is_front, float time)
+void PathTracer::Scatter(const HitRecord& hit_record,
+                         const glm::vec3& dir_out,
+                         int bounce,
+                         const glm::vec3& throughput,
+                         Sampler& sampler,
+                         PathScatter* scatter) const
 {
-  if (glm::abs(glm::length(normal) - 1.0f) > 1e-3f) {
-    throw "Unnormalized normal!";
-  }
-  if (glm::abs(glm::length(dir_out) - 1.0f) > 1e-3f) {
-    throw "Unnormalized out ray!";
-  }
-  // If just reach limit, allow the ray to bounce back once, so it can get diffuse light or direct light
-  if (bounce_cnt_ >= render_settings_->num_bounces + 1) {
-    return glm::vec3{ 0.0f };
-  }
-  if (glm::dot(dir_out, normal) < 0.0f) {
-    LAND_WARN("Bounce {}, normal direction incorrect! Normal {}, out ray {}, product {}", bounce_cnt_, glm::to_string(normal), glm::to_string(dir_out), glm::dot(dir_out, normal));
-  }
-  //LAND_INFO("Bounce {}, normal direction correct", bounce_cnt_);
-  glm::vec3 dir_in = -dir_out; // reverse light path
-  glm::vec3 dir_reflect = glm::reflect(dir_in, normal);
+  using Kernel = void (PathTracer::*)(const HitRecord&, const Entity&, const glm::vec3&, int,
+    const glm::vec3&, Sampler&, PathScatter*) const;
+  // Indexed by Material::GetShadingKernel
+  static constexpr Kernel kKernels[kNumShadingKernels] = {
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_LAMBERTIAN, false>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_LAMBERTIAN, true>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_SPECULAR, false>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_SPECULAR, true>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_TRANSMISSIVE, false>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_TRANSMISSIVE, true>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_PRINCIPLED, false>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_PRINCIPLED, true>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_EMISSION, false>,
+    &PathTracer::ScatterKernel_<MATERIAL_TYPE_EMISSION, true>,
+  };
+  const Entity& entity = scene_->GetEntity(hit_record.hit_entity_id);
+  (this->*kKernels[entity.GetShadingKernel()])(hit_record, entity, dir_out, bounce, throughput, sampler, scatter);
+}
 
-  float ior_in_over_refract = 1.0f / ior; // eta_i / eta_t
-  if (!is_front) {
-    ior_in_over_refract = ior;
+template <MaterialType kType, bool kNormalMap>
+void PathTracer::ScatterKernel_(const HitRecord& hit_record,
+                                const Entity& entity,
+                                const glm::vec3& dir_out,
+                                int bounce,
+                                const glm::vec3& throughput,
+                                Sampler& sampler,
+                                PathScatter* scatter) const
+{
+  *scatter = PathScatter{};
+  if constexpr (kType == MATERIAL_TYPE_EMISSION) { // Counted by ResolveEmission, paths end at lights
+    return;
   }
-  glm::vec3 dir_refract = glm::refract(dir_in, normal, ior_in_over_refract);
+  const Material& material = entity.GetMaterial();
+  glm::vec3 p = hit_record.position;
+  glm::vec3 hit_color = glm::vec3{ scene_->GetTextures()[material.albedo_texture_id].Sample(
+                hit_record.tex_coord) } * material.albedo_color;
+  glm::vec3 normal = GetShadingNormal_<kNormalMap>(hit_record, material);
+  // Russian roulette: paths that carry little light are likely to stop
+  const float prob_rr = glm::min(render_settings_->prob_rr,
+    glm::max(throughput.x, glm::max(throughput.y, throughput.z)));
 
-  bool is_total_reflect = glm::length(dir_refract) < 1e-3f; // If total refract, dir_refract = (0,0,0)
+  // Next event estimation, shared by diffuse and principled materials.
+  // Picks the envmap with prob_envmap, else a light. Dimensions are drawn either way
+  const float prob_envmap = GetEnvmapLightProb_();
+  const bool nee_envmap = sampler.Get1D() < prob_envmap;
+  // @return false if no light reaches p
+  auto sample_light = [&](glm::vec3* ray, float* pdf_light, glm::vec3* light_emission, glm::vec3* light_normal) {
+    int sample_light_idx;
+    glm::vec3 sample_light_pos;
+    *pdf_light = scene_->GetLights().Sample(p, normal, &sample_light_idx, &sample_light_pos, sampler)
+      * (1.0f - prob_envmap);
+    if (*pdf_light <= 0.0f) {
+      return false;
+    }
+    const Light* light = scene_->GetLights().GetLight(sample_light_idx);
+    *ray = sample_light_pos - p;
+    scatter->has_light_ray = true;
+    scatter->light_direction = glm::normalize(*ray);
+    scatter->light_position = sample_light_pos;
+    *light_emission = light->emission * light->emission_strength;
+    *light_normal = light->geometry->GetNormal();
+    return true;
+  };
+  // @return false if the envmap is black toward the sampled direction. *pdf_envmap in solid angle
+  auto sample_envmap = [&](glm::vec3* direction, float* pdf_envmap, glm::vec3* envmap_radiance) {
+    *envmap_radiance = scene_->SampleEnvmapLight(sampler.Get2D(), direction, pdf_envmap);
+    *pdf_envmap *= prob_envmap;
+    if (*pdf_envmap <= 0.0f) {
+      return false;
+    }
+    scatter->has_light_ray = true;
+    scatter->light_is_envmap = true;
+    scatter->light_direction = *direction;
+    return true;
+  };
 
-  // Compute fresnel;
-  float fr = 1.0f; // default: reflection only
-  if (!is_total_reflect) { // Refraction exists, calculate true fr
-    // Schlicks approximation
-    float cos_thetai = -glm::dot(dir_in, normal);
-    float r0 = (1 - ior) * (1 - ior) / (1 + ior) / (1 + ior); // fresnel term when thetai=0
-    fr = r0 + (1 - r0) * (1 - cos_thetai) * (1 - cos_thetai) * (1 - cos_thetai) * (1 - cos_thetai) * (1 - cos_thetai);
-  }
+  if constexpr (kType == MATERIAL_TYPE_LAMBERTIAN) {
+    glm::vec3 ray;
+    float pdf_light;
+    glm::vec3 light_emission, light_normal;
+    if (nee_envmap) {
+      // Misses of the path are not counted, so the envmap is sampled without MIS
+      if (sample_envmap(&ray, &pdf_light, &light_emission)) {
+        float cos_hit = glm::abs(glm::dot(normal, ray));
+        scatter->light_radiance = light_emission * hit_color * sparks::INV_PI * cos_hit / pdf_light;
+      }
+    }
+    else if (sample_light(&ray, &pdf_light, &light_emission, &light_normal)) {
+      float cos_hit = glm::abs(glm::dot(normal, glm::normalize(ray)));
+      scatter->light_radiance = light_emission * hit_color * sparks::INV_PI
+        * cos_hit / glm::dot(ray, ray) / pdf_light;
+      scatter->light_abs_cosine = true;
+    }
 
-  // Sample to determine reflection/refraction
-  float random_sample = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng_);
-  if (is_total_reflect || random_sample < fr) { // Reflect
-    HitRecord hit_record_ind;
-    float dist = scene_->TraceRay(p, dir_reflect, time, 1e-3f, 1e4f, &hit_record_ind);
-    if (dist > 0.0f) { // hit
-      bounce_cnt_++;
-      return albedo_color * Shade_(hit_record_ind, -dir_reflect, time);
+    float sample_prob = sampler.Get1D();
+    if (bounce < render_settings_->num_bounces && sample_prob < prob_rr) {
+      float pdf;
+      glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, sampler, &pdf);
+      if (pdf > 0.0f) {
+        scatter->has_next_ray = true;
+        scatter->next_direction = ray_in_reverse;
+        scatter->next_weight = (hit_color * INV_PI)
+          * glm::abs(glm::dot(normal, ray_in_reverse)) / pdf;
+        scatter->next_rr_scale = 1.0f / prob_rr;
+      }
     }
-    else {
-      return glm::vec3{ 0.0f };
+  }
+  else if constexpr (kType == MATERIAL_TYPE_SPECULAR) {
+    // If just reach limit, allow the ray to bounce back once
+    if (bounce < render_settings_->num_bounces + 1) {
+      scatter->has_next_ray = true;
+      scatter->next_direction = glm::reflect(-dir_out, normal);
+      scatter->next_weight = hit_color;
+      scatter->count_emission = true;
     }
   }
-  else { // Refract
-    // Compute refract light
-    glm::vec3 color_refract{ 0.0f };
-    HitRecord hit_record_refract;
-    float dist_refract = scene_->TraceRay(p, dir_refract, time, 1e-3f, 1e4f, &hit_record_refract);
-    if (dist_refract > 0.0f) { // hit
-      bounce_cnt_++;
-      return albedo_color * Shade_(hit_record_refract, -dir_refract, time);
+  else if constexpr (kType == MATERIAL_TYPE_TRANSMISSIVE) {
+    if (bounce >= render_settings_->num_bounces + 1) {
+      return;
     }
-    else {
-      return glm::vec3{ 0.0f };
+    float ior = material.ior;
+    glm::vec3 dir_in = -dir_out;
+    float ior_in_over_refract = hit_record.front_face ? 1.0f / ior : ior;
+    glm::vec3 dir_refract = glm::refract(dir_in, normal, ior_in_over_refract);
+    bool is_total_reflect = glm::length(dir_refract) < 1e-3f;
+    float fr = 1.0f;
+    if (!is_total_reflect) { // Schlick's approximation
+      float cos_thetai = -glm::dot(dir_in, normal);
+      float r0 = (1 - ior) * (1 - ior) / (1 + ior) / (1 + ior);
+      fr = r0 + (1 - r0) * (1 - cos_thetai) * (1 - cos_thetai) * (1 - cos_thetai) * (1 - cos_thetai) * (1 - cos_thetai);
     }
-  }
-}
+    float random_sample = sampler.Get1D();
+    scatter->has_next_ray = true;
+    scatter->next_direction = (is_total_reflect || random_sample < fr)
+      ? glm::reflect(dir_in, normal) : dir_refract;
+    scatter->next_weight = hit_color;
+    scatter->count_emission = true;
+  }
+  else if constexpr (kType == MATERIAL_TYPE_PRINCIPLED) {
+    bool is_front_face = hit_record.front_face;
+    const PrincipledBsdf& bsdf = entity.GetBsdf();
+    int lobe = bsdf.SampleLobe(sampler);
 
-// Based on https://github.com/mmp/pbrt-v3/
-glm::vec3 PathTracer::ShadeBsdf_(
-  const glm::vec3& p,
-  const glm::vec3& dir_out,
-  const glm::vec3& normal, 
-  const Material& material, 
-  bool is_front_face,
-  float time)
-{
-  glm::vec3 color = material.albedo_color;
-  float metallic_weight = material.metallic;
-  float ior = material.ior;
-  float spec_trans = material.spec_trans;
-  float diffuse_weight = (1 - metallic_weight) * (1 - spec_trans);
-  float diff_trans = material.diff_trans; // 0: all reflect -> 1: all transmit
-  float rough = material.roughness;
-  std::vector<std::unique_ptr<Bxdf> > bxdfs; // store a list of bxdfs
-  std::vector<float> bxdf_weights; // store sample weights
-  
-  if (diffuse_weight > 0) {
-    if (material.thin) {
-      float flat = material.flatness;
-      // TODO: Push diffuse and fakess into bxdfs
-      bxdfs.push_back(std::make_unique<DisneyDiffuse>(color));
-      bxdf_weights.push_back(diffuse_weight * (1 - flat) * (1 - diff_trans));
-      bxdfs.push_back(std::make_unique<DisneyFakess>(color, rough));
-      bxdf_weights.push_back(diffuse_weight * flat * (1 - diff_trans));
+    // IS method 1: Sampling the light
+    glm::vec3 ray;
+    float pdf_light;
+    glm::vec3 light_emission, light_normal;
+    if (nee_envmap) {
+      if (sample_envmap(&ray, &pdf_light, &light_emission)) {
+        float cos_hit = glm::max(0.0f, glm::dot(normal, ray));
+        float pdf_bsdf = bsdf.GetPdf(lobe, normal, dir_out, -ray, is_front_face);
+        scatter->light_radiance = light_emission
+          * bsdf.GetBsdf(lobe, normal, dir_out, -ray, is_front_face)
+          * cos_hit / pdf_light * power_heuristic(1, pdf_light, 1, pdf_bsdf);
+      }
     }
-    else {
-      LAND_ERROR("Not implemented for thick material!");
+    else if (sample_light(&ray, &pdf_light, &light_emission, &light_normal)) {
+      float cos_hit = glm::max(0.0f, glm::dot(normal, glm::normalize(ray)));
+      float pdf_bsdf = bsdf.GetPdf(lobe, normal, dir_out, glm::normalize(-ray), is_front_face);
+      // MIS weighs pdfs of the same measure, solid angle at p
+      float pdf_light_solid_angle = pdf_light * glm::dot(ray, ray)
+        / glm::max(glm::abs(glm::dot(light_normal, glm::normalize(ray))), 1e-6f);
+      scatter->light_radiance = light_emission
+        * bsdf.GetBsdf(lobe, normal, dir_out, glm::normalize(-ray), is_front_face)
+        * cos_hit / glm::dot(ray, ray) / pdf_light
+        * power_heuristic(1, pdf_light_solid_angle, 1, pdf_bsdf);
     }
-    // Retro-reflection.
-    bxdfs.push_back(std::make_unique<DisneyRetro>(color, rough));
-    bxdf_weights.push_back(diffuse_weight);
-  }
-  // microfacet distribution
-  float aspect = 1.0f; // fix anisotrophic=0.0f
-  float alpha_x = glm::max(1e-3f, rough * rough / aspect);
-  float alpha_y = glm::max(1e-3f, rough * rough * aspect);
-  auto distrib = std::make_unique<MicrofacetDistribution>(alpha_x, alpha_y, normal);
-
-  glm::vec3 c_spec0 = linear_interpolate(metallic_weight, glm::vec3{ (ior - 1) * (ior - 1) / (ior + 1) / (ior + 1) }, color);
-  auto fresnel = std::make_unique<Fresnel>(c_spec0, metallic_weight, ior);
-  // Add weight according to spec_trans
-  float reflect_weight = glm::max(1e-3f, 1 - spec_trans);
-  bxdfs.push_back(std::make_unique<MicrofacetReflection>(glm::vec3{ 1.0f / reflect_weight }, std::move(distrib), std::move(fresnel)));
-  bxdf_weights.push_back(reflect_weight);
 
-  // transmission
-  if (spec_trans > 0.0f) {
-    // Walter et al's model, with the provided transmissive term scaled
-    // by sqrt(color), so that after two refractions, we're back to the
-    // provided color.
-    glm::vec3 T = glm::sqrt(color);
-    if (material.thin) {
-      // Scale roughness based on IOR (Burley 2015, Figure 15).
-      float rscaled = (0.65f * ior - 0.35f) * rough;
-      float alpha_x = glm::max(1e-3f, rscaled * rscaled / aspect);
-      float alpha_y = glm::max(1e-3f, rscaled * rscaled * aspect);
-      auto scaled_distrib = std::make_unique<MicrofacetDistribution>(alpha_x, alpha_y, normal);
-      bxdfs.push_back(std::make_unique<MicrofacetTransmission>(T, std::move(scaled_distrib), 1.0f, ior));
-      bxdf_weights.push_back(spec_trans);
-    }
-    else {
-      LAND_ERROR("Not implemented!");
+    // IS method 2: Sampling the bsdf. The sample also continues the path
+    float pdf_dir_bsdf = 0.0f;
+    glm::vec3 ray_in;
+    glm::vec3 f = bsdf.SampleRayIn(lobe, normal, dir_out, &ray_in, &pdf_dir_bsdf, sampler, is_front_face);
+    float sample_prob = sampler.Get1D();
+    if (pdf_dir_bsdf > 0.0f) {
+      scatter->has_next_ray = true;
+      scatter->next_direction = -ray_in;
+      scatter->next_weight = f * glm::abs(glm::dot(normal, -ray_in)) / pdf_dir_bsdf;
+      scatter->count_emission = true;
+      scatter->next_pdf = pdf_dir_bsdf;
+      scatter->position = p;
+      scatter->normal = normal;
+      // Lights the sample hits count in full, Russian roulette only decides
+      // whether the path goes on past them
+      if (bounce < render_settings_->num_bounces && sample_prob < prob_rr) {
+        scatter->next_rr_scale = 1.0f / prob_rr;
+      }
+      else {
+        scatter->next_emission_only = true;
+      }
     }
   }
-  if (material.thin) {
-    bxdfs.push_back(std::make_unique<LambertianTransmission>(color));
-    bxdf_weights.push_back(diff_trans);
-  }
-
-  // Sample bxdf
-  //int bxdf_idx = std::uniform_int_distribution<int>(0, bxdfs.size() - 1)(rng_);
-  int bxdf_idx = std::discrete_distribution<int>(bxdf_weights.begin(), bxdf_weights.end())(rng_);
-  Bxdf* bxdf = bxdfs[bxdf_idx].get();
+}
 
-  // Similar to diffuse
-  if (glm::abs(glm::length(normal) - 1.0f) > 1e-3f) { // Check if normalized
-    throw "Unnormalized normal!";
+glm::vec3 PathTracer::ResolveLightRay(const PathScatter& scatter, float t, const HitRecord& hit_record) const
+{
+  if (scatter.light_is_envmap) {
+    return t > 0.0f ? glm::vec3{ 0.0f } : scatter.light_radiance;
   }
-  // Direct light
-  glm::vec3 radiance_dir{ 0.0f };
-  int sample_light_idx;
-  glm::vec3 sample_light_pos;
-  // IS method 1: Sampling the light
-  float pdf_light = scene_->GetLights().Sample(&sample_light_idx, &sample_light_pos, rng_);
-  const Light* sample_light = scene_->GetLights().GetLight(sample_light_idx);
-  // Test blocking to sampled light source
-  HitRecord hit_record_dir;
-  glm::vec3 ray = sample_light_pos - p; // ray to light
-  //scene_->TraceRay(p, glm::normalize(ray), 1e-3f, 1e4f, &hit_record);
-  scene_->TraceRay(p, glm::normalize(ray), time, 1e-3f, 1e4f, &hit_record_dir);
-  auto hit_normal = hit_record_dir.normal; // normal of intersection
-  if (glm::abs(glm::length(hit_normal) - 1.0f) > 1e-3f) { // Check if normalized
-    throw "Unnormalized normal!";
+  // Lights emit on both sides, as when hit by the path
+  if (t <= 0.0f || glm::distance(hit_record.position, scatter.light_position) >= 1e-3f) { // Blocked
+    return glm::vec3{ 0.0f };
   }
-  if (glm::distance(hit_record_dir.position, sample_light_pos) < 1e-3f) { // No blocking
-    float cos_hit = glm::dot(normal, glm::normalize(ray));
-    float cos_light = glm::dot(hit_normal, glm::normalize(-ray));
-    // In case cosine < 0 
-    if (cos_hit < 0.0f) {
-      cos_hit = 0.0f;
-    }
-    if (cos_light < 0.0f) {
-      cos_light = 0.0f;
+  float cos_light = glm::dot(hit_record.normal, -scatter.light_direction);
+  cos_light = scatter.light_abs_cosine ? glm::abs(cos_light) : glm::max(cos_light, 0.0f);
+  return scatter.light_radiance * cos_light;
+}
+
+glm::vec3 PathTracer::ResolveEmission(const PathScatter& scatter, const glm::vec3& direction, float t, const HitRecord& hit_record) const
+{
+  if (t <= 0.0f) {
+    glm::vec3 envmap = glm::vec3{ scene_->SampleEnvmap(direction) };
+    if (scatter.next_pdf <= 0.0f) {
+      return envmap;
     }
-    // Compute MIS weight
-    float pdf_bsdf = bxdf->GetPdf(normal, dir_out, glm::normalize(-ray), is_front_face);
-    float weight = power_heuristic(1, pdf_light, 1, pdf_bsdf);
-    float square_dist = glm::dot(ray, ray); // squared distance from p to light
-    radiance_dir += sample_light->emission * sample_light->emission_strength
-      * bxdf->GetBsdf(normal, dir_out, glm::normalize(-ray), is_front_face)
-      * cos_hit * cos_light / square_dist / pdf_light * weight;
-    //if (glm::any(glm::lessThan(radiance_dir, glm::vec3{ 0.0f }))) {
-    //  LAND_ERROR("Negative color, bsdf {}, cos_hit {}, cos_light {}",
-    //    glm::to_string(bxdf->GetBsdf(normal, dir_out, glm::normalize(-ray))),
-    //    cos_hit, cos_light);
-    //}
+    float pdf_envmap = GetEnvmapLightProb_() * scene_->GetEnvmapLightPdf(direction);
+    return envmap * power_heuristic(1, scatter.next_pdf, 1, pdf_envmap);
   }
-  // IS method 2: Sampling the bsdf
-  float pdf_dir_bsdf;
-  //glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, rng_, &pdf_indir); // Sampled incident ray, but pointing outward
-  glm::vec3 ray_in;
-  glm::vec3 bsdf = bxdf->SampleRayIn(normal, dir_out, &ray_in, &pdf_dir_bsdf, rng_, is_front_face);
-  if (pdf_dir_bsdf > 0.0f) { // Only do the following if the sampled ray is valid
-    glm::vec3 ray_in_reverse = -ray_in;
-    //glm::vec3 ray_in_reverse = hemisphere_sample(normal, rng_);
-    //pdf = 0.5 * INV_PI;
-    HitRecord hit_record_dir_bsdf;
-    //float dist = scene_->TraceRay(p, ray_in_reverse, 1e-3f, 1e4f, &hit_record_ind);
-    float dist = scene_->TraceRay(p, ray_in_reverse, time, 1e-3f, 1e4f, &hit_record_dir_bsdf);
-    if (dist > 0.0f) { // hit
-      const Material& hit_material = scene_->GetEntity(hit_record_dir_bsdf.hit_entity_id).GetMaterial();
-      if (hit_material.material_type == MATERIAL_TYPE_EMISSION) { // is a light source
-        glm::vec3 color = Shade_(hit_record_dir_bsdf, -ray_in_reverse, time);
-        // Compute MIS weight
-        float pdf_light = 1.0f / scene_->GetLights().GetTotalArea();
-        float weight = power_heuristic(1, pdf_dir_bsdf, 1, pdf_light);
-        radiance_dir += color * bsdf
-          * glm::abs(glm::dot(normal, ray_in_reverse)) / pdf_dir_bsdf * weight;
-      }
-      //if (glm::any(glm::lessThan(radiance_indir, glm::vec3{ 0.0f }))) {
-      //  LAND_ERROR("Negative color {}, bsdf {}, cosine {}", glm::to_string(radiance_indir), glm::to_string(bsdf), glm::dot(normal, ray_in_reverse));
-      //}
-    }
+  const Entity& entity = scene_->GetEntity(hit_record.hit_entity_id);
+  const Material& material = entity.GetMaterial();
+  if (material.material_type != MATERIAL_TYPE_EMISSION) {
+    return glm::vec3{ 0.0f };
   }
-  // Indirect light
-  glm::vec3 radiance_indir{ 0.0f };
-  float sample_prob = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng_);
-  if (bounce_cnt_ < render_settings_->num_bounces
-    && sample_prob < render_settings_->prob_rr)
-  { // Bounce count did not reach limit and passed russian roulette
-    float pdf_indir;
-    //glm::vec3 ray_in_reverse = hemisphere_sample_cosine_weighted(normal, rng_, &pdf_indir); // Sampled incident ray, but pointing outward
-    glm::vec3 ray_in;
-    glm::vec3 bsdf = bxdf->SampleRayIn(normal, dir_out, &ray_in, &pdf_indir, rng_, is_front_face);
-    if (pdf_indir > 0.0f) { // Only do the following if the sampled ray is valid
-      glm::vec3 ray_in_reverse = -ray_in;
-      //glm::vec3 ray_in_reverse = hemisphere_sample(normal, rng_);
-      //pdf = 0.5 * INV_PI;
-      HitRecord hit_record_ind;
-      //float dist = scene_->TraceRay(p, ray_in_reverse, 1e-3f, 1e4f, &hit_record_ind);
-      float dist = scene_->TraceRay(p, ray_in_reverse, time, 1e-3f, 1e4f, &hit_record_ind);
-      if (dist > 0.0f) { // hit
-        const Material& hit_material = scene_->GetEntity(hit_record_ind.hit_entity_id).GetMaterial();
-        if (hit_material.material_type != MATERIAL_TYPE_EMISSION) { // not emission
-          bounce_cnt_++;
-          glm::vec3 color = Shade_(hit_record_ind, -ray_in_reverse, time);
-          radiance_indir = color * bsdf
-            * glm::abs(glm::dot(normal, ray_in_reverse)) / pdf_indir / render_settings_->prob_rr;
-        }
-        if (glm::any(glm::lessThan(radiance_indir, glm::vec3{ 0.0f }))) {
-          LAND_ERROR("Negative color {}, bsdf {}, cosine {}", glm::to_string(radiance_indir), glm::to_string(bsdf), glm::dot(normal, ray_in_reverse));
-        }
-      }
-    }
+  glm::vec3 color = ShadeEmission_(-direction,
+    GetShadingNormal(hit_record, material), material.emission, material.emission_strength);
+  if (scatter.next_pdf <= 0.0f) {
+    return color;
   }
-  return radiance_dir + radiance_indir;
+  // The pdf of picking the light depends on the light and the shading point.
+  // Emitters that are not lights can only be hit
+  int light_index = entity.GetLightIndex();
+  float pdf_light = 0.0f;
+  if (light_index >= 0) {
+    const Lights& lights = scene_->GetLights();
+    float cos_light = glm::abs(glm::dot(lights.GetLight(light_index)->geometry->GetNormal(), direction));
+    pdf_light = lights.GetPdf(light_index, scatter.position, scatter.normal)
+      * (1.0f - GetEnvmapLightProb_()) * t * t / glm::max(cos_light, 1e-6f);
+  }
+  return color * power_heuristic(1, scatter.next_pdf, 1, pdf_light);
 }
 }  // namespace sparks
@@ -1,11 +1,41 @@
 #pragma once
 #include "random"
+#include "sparks/util/sampler.h"
 #include "sparks/assets/scene.h"
 #include "sparks/renderer/renderer_settings.h"
-#include "sparks/materials/bxdfs_all.h"
 #include "sparks/util/distribution.h"
 
 namespace sparks {
+/* @brief Outcome of shading one vertex of a path. Rays it needs are returned
+* instead of traced, so a caller can trace the rays of many paths together.
+*/
+struct PathScatter {
+  // Next event estimation toward a sampled point on a light, or the envmap
+  bool has_light_ray{false};
+  bool light_is_envmap{false}; // Unblocked if the ray misses the scene
+  glm::vec3 light_direction{0.0f};
+  glm::vec3 light_position{0.0f};
+  glm::vec3 light_radiance{0.0f}; // Still to be scaled by the cosine at the light
+  bool light_abs_cosine{false};
+  // Continuation of the path
+  bool has_next_ray{false};
+  glm::vec3 next_direction{0.0f};
+  glm::vec3 next_weight{0.0f};
+  // 1 / survival probability of Russian roulette. Applied to the throughput
+  // only after the emission of the next vertex, which counts either way
+  float next_rr_scale{1.0f};
+  bool count_emission{false}; // Whether the emission of the next vertex counts
+  // BSDF pdf of next_direction. If positive, the emission of the next vertex
+  // is MIS weighted against next event estimation
+  float next_pdf{0.0f};
+  // The path ends at the next vertex, traced only for its MIS weighted
+  // emission (bounce limit or Russian roulette)
+  bool next_emission_only{false};
+  // Shading point and normal, which pick lights from the light tree
+  glm::vec3 position{0.0f};
+  glm::vec3 normal{0.0f};
+};
+
 class PathTracer {
  public:
   PathTracer(const RendererSettings *render_settings, const Scene *scene, unsigned int seed);
@@ -28,10 +58,10 @@ class PathTracer {
 
   /**
   @brief Get the color sampled from one ray.
-  Path tracing ray sampling method. It will not be called recursively
+  Path tracing ray sampling method. The path is followed in a loop that
+  carries its throughput, and ends by Russian roulette or the bounce limit
   @param origin, camera position
   @param direction, ray direction
-  @param bounce_cnt, counter of recursion, avoid infinite recursion (like two mirrors)
   @return color
   */
   [[nodiscard]] glm::vec3 SampleRayPathTrace(
@@ -39,51 +69,73 @@ class PathTracer {
     glm::vec3 direction,
     float time);
 
-  void SetSeed(int seed) {
-    rng_.seed(seed);
+  // The scatter of the camera: its ray counts the emission it sees in full
+  [[nodiscard]] static PathScatter GetCameraScatter();
+
+  /* @brief Shade one path vertex without tracing any ray. Random numbers are
+  * drawn from sampler in the same order as SampleRayPathTrace draws them.
+  * @param bounce, number of bounces before this vertex
+  * @param throughput, of the path up to this vertex. Sets the survival
+  * probability of Russian roulette
+  */
+  void Scatter(const HitRecord &hit_record,
+               const glm::vec3 &dir_out,
+               int bounce,
+               const glm::vec3 &throughput,
+               Sampler &sampler,
+               PathScatter *scatter) const;
+  // Radiance of a light ray of scatter, given what the ray hit
+  [[nodiscard]] glm::vec3 ResolveLightRay(const PathScatter &scatter,
+                                          float t,
+                                          const HitRecord &hit_record) const;
+  /* @brief Light reaching the previous vertex along the ray continuing it:
+  * the emission of the surface hit, or the envmap if t <= 0. Weighted by MIS
+  * if the previous vertex sampled the ray by its BSDF
+  * @param scatter, of the previous vertex. Ignored for camera rays
+  */
+  [[nodiscard]] glm::vec3 ResolveEmission(const PathScatter &scatter,
+                                          const glm::vec3 &direction,
+                                          float t,
+                                          const HitRecord &hit_record) const;
+
+  // Normal at the hit point after applying the normal texture of material
+  [[nodiscard]] glm::vec3 GetShadingNormal(const HitRecord &hit_record,
+                                           const Material &material) const;
+
+  // Started by Renderer::GeneratePrimaryRay for each sample
+  [[nodiscard]] Sampler &GetSampler() {
+    return sampler_;
+  }
+
+  void SetScene(const Scene *scene) {
+    scene_ = scene;
+  }
+  [[nodiscard]] const Scene *GetScene() const {
+    return scene_;
   }
 
  private:
   const RendererSettings *render_settings_{};
   const Scene *scene_{};
-  std::mt19937 rng_{ std::random_device()() };
-  int bounce_cnt_{ 0 }; // number of bounces
+  Sampler sampler_;
 
-  /* @brief Get the color of scene point p given out ray direction, using path tracing.
-  * Will be called recursively
-  * @param p, the point on scene. p is guaranteed not to be on light source
-  * @param dir_out, the out direction
-  * @param seed: Only used as seed for sampling.
-  */
-  [[nodiscard]] glm::vec3 Shade_(const HitRecord& hit_record, const glm::vec3& dir_out, float time);
-  /* @brief Compute light for diffuse material
-  * @param p, position on diffuse material 
-  * @param dir_out, normalized and points outward, we collect color observed from that direction
-  * @param albedo_color, the base color
-  * @param normal, the normal at p
+  // Probability that next event estimation samples the envmap rather than a light
+  [[nodiscard]] float GetEnvmapLightProb_() const;
+  // GetShadingNormal, knowing whether material has a normal map
+  template <bool kNormalMap>
+  [[nodiscard]] glm::vec3 GetShadingNormal_(const HitRecord &hit_record,
+                                            const Material &material) const;
+  /* @brief Scatter specialized for one material type and normal map use, so
+  * it does not branch on them and inlines the BSDF of the type.
   */
-  [[nodiscard]] glm::vec3 ShadeDiffuse_(const glm::vec3& p, const glm::vec3& dir_out, const glm::vec3& albedo_color, const glm::vec3& normal, float time);
-  [[nodiscard]] glm::vec3 ShadeSpecular_(
-    const glm::vec3& p,
-    const glm::vec3& dir_out,
-    const glm::vec3& normal,
-    const glm::vec3& albedo_color,
-    float time);
-  [[nodiscard]] glm::vec3 ShadeTransmissive_(
-    const glm::vec3& p,
-    const glm::vec3& dir_out,
-    const glm::vec3& normal,
-    const glm::vec3& albedo_color,
-    float ior, 
-    bool is_front,
-    float time);
-  [[nodiscard]] glm::vec3 ShadeBsdf_(
-    const glm::vec3& p,
-    const glm::vec3& dir_out, 
-    const glm::vec3& normal,
-    const Material& material, 
-    bool is_front_face,
-    float time);
+  template <MaterialType kType, bool kNormalMap>
+  void ScatterKernel_(const HitRecord &hit_record,
+                      const Entity &entity,
+                      const glm::vec3 &dir_out,
+                      int bounce,
+                      const glm::vec3 &throughput,
+                      Sampler &sampler,
+                      PathScatter *scatter) const;
   // Only consider emission light
   [[nodiscard]] glm::vec3 ShadeEmission_( 
     const glm::vec3& dir_out, 
@@ -0,0 +1,150 @@
+#include "sparks/renderer/photon_map.h"
+
+#include "algorithm"
+#include "sparks/util/sample.h"
+
+namespace sparks {
+PhotonMap::PhotonMap(const RendererSettings *render_settings,
+                     uint32_t seed,
+                     float radius)
+    : render_settings_(render_settings),
+      seed_(seed),
+      radius_(radius),
+      cell_size_(2.0f * radius),
+      num_emitted_(std::max(render_settings->photons_per_pass, 0)) {
+  num_chunks_ = (num_emitted_ + kChunkSize - 1) / kChunkSize;
+  chunks_.resize(num_chunks_);
+  num_buckets_ = 1; // About one per photon emitted
+  while (num_buckets_ < uint32_t(num_emitted_)) {
+    num_buckets_ *= 2;
+  }
+  bucket_start_.assign(num_buckets_ + 1, 0);
+  bucket_cursor_ = std::make_unique<std::atomic<uint32_t>[]>(num_buckets_);
+  if (!num_chunks_) {
+    traced_ = true;
+    inserted_ = true;
+  }
+}
+
+void PhotonMap::Build(const PathTracer &path_tracer) {
+  for (int chunk = next_trace_chunk_++; chunk < num_chunks_;
+       chunk = next_trace_chunk_++) {
+    TraceChunk_(path_tracer, chunk);
+    if (++num_traced_chunks_ == num_chunks_) {
+      AllocateBuckets_();
+      std::lock_guard<std::mutex> lock(mutex_);
+      traced_ = true;
+      phase_cv_.notify_all();
+    }
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  phase_cv_.wait(lock, [this] { return traced_; });
+  lock.unlock();
+
+  for (int chunk = next_insert_chunk_++; chunk < num_chunks_;
+       chunk = next_insert_chunk_++) {
+    InsertChunk_(chunk);
+    if (++num_inserted_chunks_ == num_chunks_) {
+      bucket_cursor_.reset();
+      lock.lock();
+      inserted_ = true;
+      phase_cv_.notify_all();
+      lock.unlock();
+    }
+  }
+  lock.lock();
+  phase_cv_.wait(lock, [this] { return inserted_; });
+}
+
+bool PhotonMap::IsGatherSurface(const Material &material) {
+  // Glass is seen through rather than lit, its caustics land behind it
+  return material.material_type == MATERIAL_TYPE_LAMBERTIAN ||
+         (material.material_type == MATERIAL_TYPE_PRINCIPLED &&
+          material.spec_trans == 0.0f);
+}
+
+void PhotonMap::TraceChunk_(const PathTracer &path_tracer, int chunk) {
+  const Scene &scene = *path_tracer.GetScene();
+  const Lights &lights = scene.GetLights();
+  Chunk &result = chunks_[chunk];
+  Sampler sampler{render_settings_->sampler};
+  PathScatter scatter;
+  HitRecord hit_record;
+  int end = std::min(num_emitted_, (chunk + 1) * kChunkSize);
+  for (int i = chunk * kChunkSize; i < end && lights.GetLightCount(); i++) {
+    // The photons of a pass are the samples of one pixel
+    sampler.StartSample(seed_, 0, uint32_t(i));
+    int light_index;
+    glm::vec3 origin;
+    float pdf_position = lights.Sample(&light_index, &origin, sampler);
+    if (pdf_position <= 0.0f) {
+      continue;
+    }
+    const Light *light = lights.GetLight(light_index);
+    glm::vec3 normal = light->geometry->GetNormal();
+    float pdf_direction;
+    glm::vec3 direction =
+        hemisphere_sample_cosine_weighted(normal, sampler, &pdf_direction);
+    if (sampler.Get1D() < 0.5f) { // Both sides emit, as for the camera paths
+      direction = -direction;
+    }
+    pdf_direction *= 0.5f;
+    if (pdf_direction <= 0.0f) {
+      continue;
+    }
+    // Photons sample the shutter like camera rays
+    float time = sampler.Get1D() * scene.GetCamera().GetShutter();
+    glm::vec3 power = light->emission * light->emission_strength *
+                      glm::abs(glm::dot(normal, direction)) /
+                      (pdf_position * pdf_direction);
+    // Relative to power, so Russian roulette treats photons like camera paths
+    glm::vec3 beta{1.0f};
+    for (int bounce = 0;; bounce++) {
+      float t =
+          scene.TraceRay(origin, direction, time, 1e-3f, 1e4f, &hit_record);
+      if (t <= 0.0f) {
+        break;
+      }
+      const Material &material =
+          scene.GetEntity(hit_record.hit_entity_id).GetMaterial();
+      // Direct light is sampled at the gather point instead
+      if (bounce > 0 && IsGatherSurface(material)) {
+        uint32_t bucket = GetBucket_(GetCell_(hit_record.position));
+        result.photons.push_back({hit_record.position, -direction, power * beta});
+        result.buckets.push_back(bucket);
+        bucket_cursor_[bucket].fetch_add(1, std::memory_order_relaxed);
+      }
+      // The light ray Scatter samples as well is not traced
+      path_tracer.Scatter(hit_record, -direction, bounce, beta, sampler,
+                          &scatter);
+      if (!scatter.has_next_ray || scatter.next_emission_only) {
+        break;
+      }
+      beta *= scatter.next_weight * scatter.next_rr_scale; // Photons carry no emission
+      origin = hit_record.position;
+      direction = scatter.next_direction;
+    }
+  }
+}
+
+void PhotonMap::AllocateBuckets_() {
+  uint32_t num_photons = 0;
+  for (uint32_t i = 0; i < num_buckets_; i++) {
+    bucket_start_[i] = num_photons;
+    num_photons += bucket_cursor_[i].load(std::memory_order_relaxed);
+    bucket_cursor_[i].store(bucket_start_[i], std::memory_order_relaxed);
+  }
+  bucket_start_[num_buckets_] = num_photons;
+  photons_.resize(num_photons);
+}
+
+void PhotonMap::InsertChunk_(int chunk) {
+  Chunk &source = chunks_[chunk];
+  for (size_t i = 0; i < source.photons.size(); i++) {
+    uint32_t index =
+        bucket_cursor_[source.buckets[i]].fetch_add(1, std::memory_order_relaxed);
+    photons_[index] = source.photons[i];
+  }
+  source = Chunk{};
+}
+}  // namespace sparks
@@ -0,0 +1,124 @@
+#pragma once
+#include "atomic"
+#include "condition_variable"
+#include "memory"
+#include "mutex"
+#include "sparks/renderer/path_tracer.h"
+#include "sparks/renderer/renderer_settings.h"
+#include "vector"
+
+namespace sparks {
+struct Photon {
+  glm::vec3 position{0.0f};
+  glm::vec3 direction{0.0f}; // Toward where the photon came from
+  glm::vec3 power{0.0f};     // Not yet divided by the number of photons emitted
+};
+
+/* @brief Photons of one pass of progressive photon mapping, in a hash grid of
+* cells twice the gather radius wide. The map is built by the workers that
+* need it: each one traces chunks of photons until none is left, then each
+* chunk is scattered into the grid the same way. Buckets are sized and filled
+* through atomics, so workers only wait for each other between the two phases.
+*/
+class PhotonMap {
+ public:
+  // Photons are traced from the sampler of render_settings, started at seed
+  PhotonMap(const RendererSettings *render_settings,
+            uint32_t seed,
+            float radius);
+
+  /* @brief Trace and insert chunks of photons until none is left, then wait
+  * for the workers still on theirs. Any number of workers can call it at once
+  * @param path_tracer, samples the scattering of the photons in its scene
+  */
+  void Build(const PathTracer &path_tracer);
+
+  // Whether photons are stored on, and gathered at, surfaces of material
+  [[nodiscard]] static bool IsGatherSurface(const Material &material);
+
+  [[nodiscard]] float GetRadius() const {
+    return radius_;
+  }
+  // Photons emitted from the lights, stored or not
+  [[nodiscard]] int GetNumEmitted() const {
+    return num_emitted_;
+  }
+
+  // Call visit on every photon within the radius of p. Only after Build
+  template <class Visit>
+  void ForEachPhoton(const glm::vec3 &p, Visit &&visit) const {
+    glm::ivec3 low = GetCell_(p - glm::vec3{radius_});
+    glm::ivec3 high = GetCell_(p + glm::vec3{radius_});
+    // The query box spans up to 2^3 cells. Cells that share a bucket are
+    // visited once
+    uint32_t visited[8];
+    int num_visited = 0;
+    for (int x = low.x; x <= high.x; x++) {
+      for (int y = low.y; y <= high.y; y++) {
+        for (int z = low.z; z <= high.z; z++) {
+          uint32_t bucket = GetBucket_(glm::ivec3{x, y, z});
+          bool seen = false;
+          for (int i = 0; i < num_visited; i++) {
+            seen |= visited[i] == bucket;
+          }
+          if (seen || num_visited == 8) {
+            continue;
+          }
+          visited[num_visited++] = bucket;
+          for (uint32_t i = bucket_start_[bucket]; i < bucket_start_[bucket + 1];
+               i++) {
+            glm::vec3 d = photons_[i].position - p;
+            if (glm::dot(d, d) <= radius_ * radius_) {
+              visit(photons_[i]);
+            }
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr int kChunkSize = 4096; // Photons emitted per chunk
+  struct Chunk {
+    std::vector<Photon> photons;
+    std::vector<uint32_t> buckets;
+  };
+
+  const RendererSettings *render_settings_{};
+  uint32_t seed_{0};
+  float radius_{0.0f};
+  float cell_size_{0.0f};
+  int num_emitted_{0};
+  int num_chunks_{0};
+  uint32_t num_buckets_{0}; // A power of two
+  std::vector<Chunk> chunks_;
+
+  // Photons sorted by bucket, those of bucket b in [bucket_start_[b], bucket_start_[b + 1])
+  std::vector<Photon> photons_;
+  std::vector<uint32_t> bucket_start_;
+  // Photon count of each bucket while tracing, then its insertion cursor
+  std::unique_ptr<std::atomic<uint32_t>[]> bucket_cursor_;
+
+  std::atomic<int> next_trace_chunk_{0};
+  std::atomic<int> num_traced_chunks_{0};
+  std::atomic<int> next_insert_chunk_{0};
+  std::atomic<int> num_inserted_chunks_{0};
+  std::mutex mutex_;
+  std::condition_variable phase_cv_;
+  bool traced_{false}; // Guarded by mutex_
+  bool inserted_{false};
+
+  void TraceChunk_(const PathTracer &path_tracer, int chunk);
+  // Lay out the buckets once every chunk is traced
+  void AllocateBuckets_();
+  void InsertChunk_(int chunk);
+  [[nodiscard]] glm::ivec3 GetCell_(const glm::vec3 &p) const {
+    return glm::ivec3{glm::floor(p / cell_size_)};
+  }
+  [[nodiscard]] uint32_t GetBucket_(const glm::ivec3 &cell) const {
+    return (uint32_t(cell.x) * 73856093u ^ uint32_t(cell.y) * 19349663u ^
+            uint32_t(cell.z) * 83492791u) &
+           (num_buckets_ - 1);
+  }
+};
+}  // namespace sparks
@@ -0,0 +1,103 @@
+#include "sparks/renderer/ppm.h"
+
+#include "cmath"
+#include "sparks/util/util.h"
+
+namespace sparks {
+PpmIntegrator::PpmIntegrator(const RendererSettings *render_settings)
+    : render_settings_(render_settings),
+      path_tracer_(render_settings, nullptr) {
+}
+
+void PpmIntegrator::SetScene(const Scene *scene) {
+  scene_ = scene;
+  path_tracer_.SetScene(scene);
+}
+
+float PpmIntegrator::GetPassRadius(float initial_radius, uint32_t pass) {
+  // r_{i+1}^2 = r_i^2 (i + alpha) / (i + 1) for passes i from 1, in closed form
+  double i = double(pass) + 1.0;
+  double ratio = std::exp(std::lgamma(i + kAlpha) - std::lgamma(1.0 + kAlpha) -
+                          std::lgamma(i + 1.0));
+  return initial_radius * float(std::sqrt(ratio));
+}
+
+glm::vec3 PpmIntegrator::SampleRay(const glm::vec3 &origin,
+                                   const glm::vec3 &direction,
+                                   float time) {
+  glm::vec3 radiance{0.0f};
+  glm::vec3 throughput{1.0f};
+  glm::vec3 ray_origin = origin;
+  glm::vec3 ray_direction = direction;
+  HitRecord hit_record;
+  HitRecord shadow_record;
+  PathScatter scatter = PathTracer::GetCameraScatter();
+  for (int bounce = 0;; bounce++) {
+    float t = scene_->TraceRay(ray_origin, ray_direction, time, 1e-3f, 1e4f,
+                               &hit_record);
+    if (scatter.count_emission) {
+      radiance += throughput * path_tracer_.ResolveEmission(
+                                   scatter, ray_direction, t, hit_record);
+    }
+    if (t <= 0.0f || scatter.next_emission_only) {
+      break;
+    }
+    throughput *= scatter.next_rr_scale;
+    bool gather = PhotonMap::IsGatherSurface(
+        scene_->GetEntity(hit_record.hit_entity_id).GetMaterial());
+    // The path ends at a gather point, its BSDF sample only finds lights for MIS
+    path_tracer_.Scatter(hit_record, -ray_direction,
+                         gather ? render_settings_->num_bounces : bounce,
+                         throughput, GetSampler(), &scatter);
+    glm::vec3 p = hit_record.position;
+    if (scatter.has_light_ray) {
+      float t_light = scene_->TraceRay(p, scatter.light_direction, time, 1e-3f,
+                                       1e4f, &shadow_record);
+      radiance += throughput *
+                  path_tracer_.ResolveLightRay(scatter, t_light, shadow_record);
+    }
+    if (gather) {
+      radiance += throughput * Gather_(hit_record, -ray_direction);
+    }
+    if (!scatter.has_next_ray) {
+      break;
+    }
+    throughput *= scatter.next_weight;
+    ray_origin = p;
+    ray_direction = scatter.next_direction;
+  }
+  radiance.x = clamp(radiance.x, 0.0f, render_settings_->max_color);
+  radiance.y = clamp(radiance.y, 0.0f, render_settings_->max_color);
+  radiance.z = clamp(radiance.z, 0.0f, render_settings_->max_color);
+  return radiance;
+}
+
+glm::vec3 PpmIntegrator::Gather_(const HitRecord &hit_record,
+                                 const glm::vec3 &dir_out) const {
+  if (!photon_map_->GetNumEmitted()) {
+    return glm::vec3{0.0f};
+  }
+  const Entity &entity = scene_->GetEntity(hit_record.hit_entity_id);
+  const Material &material = entity.GetMaterial();
+  glm::vec3 normal = path_tracer_.GetShadingNormal(hit_record, material);
+  glm::vec3 color =
+      glm::vec3{scene_->GetTextures()[material.albedo_texture_id].Sample(
+          hit_record.tex_coord)} *
+      material.albedo_color;
+  glm::vec3 sum{0.0f};
+  photon_map_->ForEachPhoton(hit_record.position, [&](const Photon &photon) {
+    if (material.material_type == MATERIAL_TYPE_LAMBERTIAN) {
+      // Photons on the other side of a thin surface do not light this side
+      if (glm::dot(normal, dir_out) * glm::dot(normal, photon.direction) > 0.0f) {
+        sum += color * INV_PI * photon.power;
+      }
+    } else {
+      sum += entity.GetBsdf().GetBsdf(normal, dir_out, -photon.direction,
+                                      hit_record.front_face) *
+             photon.power;
+    }
+  });
+  float radius = photon_map_->GetRadius();
+  return sum / (PI * radius * radius * float(photon_map_->GetNumEmitted()));
+}
+}  // namespace sparks
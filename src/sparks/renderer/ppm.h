@@ -0,0 +1,55 @@
+#pragma once
+#include "sparks/renderer/path_tracer.h"
+#include "sparks/renderer/photon_map.h"
+#include "sparks/renderer/renderer_settings.h"
+#include "sparks/util/sampler.h"
+
+namespace sparks {
+/* @brief Progressive photon mapping (Hachisuka et al. 2008), in the form of
+* Knaus and Zwicker 2011: each pass is an independent estimate with its own
+* photon map and a radius that shrinks from pass to pass, so the passes are
+* averaged like any other samples and the bias vanishes.
+* Camera paths go through glass and mirrors up to the first gather surface.
+* There direct light is sampled as PathTracer does, and the photons bring the
+* light that bounced at least once, caustics included. The envmap lights
+* gather points directly but sends no photons.
+*/
+class PpmIntegrator {
+ public:
+  explicit PpmIntegrator(const RendererSettings *render_settings);
+
+  void SetScene(const Scene *scene);
+  [[nodiscard]] const Scene *GetScene() const {
+    return scene_;
+  }
+  // Started by Renderer::GeneratePrimaryRay for each sample
+  [[nodiscard]] Sampler &GetSampler() {
+    return path_tracer_.GetSampler();
+  }
+  // Built map of the pass being rendered
+  void SetPhotonMap(const PhotonMap *photon_map) {
+    photon_map_ = photon_map;
+  }
+
+  // Radiance along a camera ray
+  [[nodiscard]] glm::vec3 SampleRay(const glm::vec3 &origin,
+                                    const glm::vec3 &direction,
+                                    float time);
+
+  // Gather radius of a pass, counted from 0
+  [[nodiscard]] static float GetPassRadius(float initial_radius, uint32_t pass);
+
+ private:
+  // Share of the photons a pass keeps from the previous one, as its area shrinks
+  static constexpr double kAlpha = 2.0 / 3.0;
+
+  const RendererSettings *render_settings_{};
+  const Scene *scene_{};
+  PathTracer path_tracer_; // Scattering, light sampling and the sampler
+  const PhotonMap *photon_map_{};
+
+  // Density estimate of the photons around a gather point
+  [[nodiscard]] glm::vec3 Gather_(const HitRecord &hit_record,
+                                  const glm::vec3 &dir_out) const;
+};
+}  // namespace sparks
@@ -2,12 +2,16 @@
 
 #include "algorithm"
 #include "random"
+#include "sparks/renderer/wavefront.h"
 #include <glm/gtx/string_cast.hpp>
 
 namespace sparks {
 
 Renderer::Renderer(const RendererSettings &renderer_settings) {
   renderer_settings_ = renderer_settings;
+  worker_groups_.resize(1);
+  task_queues_.resize(1);
+  scene_snapshots_ = CreateSnapshots_();
 }
 
 Scene &Renderer::GetScene() {
@@ -31,15 +35,54 @@ void Renderer::StartWorkerThreads() {
   uint32_t num_threads = std::thread::hardware_concurrency() - 2u;
   num_threads = std::max(num_threads, 1u);
   //num_threads = 1;
-  for (int i = 0; i < num_threads; i++) {
-    worker_threads_.emplace_back(&Renderer::WorkerThread, this);
+  std::vector<NumaNode> nodes;
+  if (renderer_settings_.numa_aware) {
+    nodes = QueryNumaTopology();
+  }
+  if (nodes.size() > 1) {
+    // Distribute threads among nodes, proportional to their cpus
+    uint32_t total_cpus = 0;
+    for (auto &node : nodes) {
+      total_cpus += uint32_t(node.cpus.size());
+    }
+    std::vector<WorkerGroup> groups(nodes.size());
+    uint32_t assigned = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      groups[i].cpus = nodes[i].cpus;
+      groups[i].num_threads = std::max(
+          1u, uint32_t(nodes[i].cpus.size()) * num_threads / total_cpus);
+      assigned += groups[i].num_threads;
+    }
+    for (size_t i = 0; assigned < num_threads; i = (i + 1) % groups.size()) {
+      groups[i].num_threads++;
+      assigned++;
+    }
+    worker_groups_ = groups;
+    task_queues_.clear();
+    task_queues_.resize(worker_groups_.size());
+    Resize(width_, height_); // Rebuild the queues for the new groups
+    scene_snapshots_ = CreateSnapshots_(); // Models replicated on each node
+  } else {
+    worker_groups_[0].num_threads = num_threads;
+  }
+  last_numa_report_ = std::chrono::steady_clock::now();
+  last_checkpoint_ = last_numa_report_;
+  RestartBudget_();
+  for (uint32_t group_index = 0; group_index < worker_groups_.size();
+       group_index++) {
+    for (uint32_t i = 0; i < worker_groups_[group_index].num_threads; i++) {
+      worker_threads_.emplace_back(&Renderer::WorkerThread, this, group_index);
+    }
+    LAND_INFO("Renderer: Started {} threads in group {} ({} cpus)",
+              worker_groups_[group_index].num_threads, group_index,
+              worker_groups_[group_index].cpus.size());
   }
-  LAND_INFO("Renderer: Started {} threads", num_threads);
 }
 
 void Renderer::PauseWorkers() {
   std::unique_lock<std::mutex> lock(task_queue_mutex_);
   render_state_signal_ = RENDER_STATE_SIGNAL_PAUSE;
+  cancel_tasks_ = true; // Tiles in flight are abandoned and retried later
   wait_for_queue_cv_.notify_all();
   if (num_paused_thread_ != worker_threads_.size()) {
     wait_for_all_pause_.wait(lock);
@@ -49,6 +92,7 @@ void Renderer::PauseWorkers() {
 void Renderer::ResumeWorkers() {
   std::unique_lock<std::mutex> lock(task_queue_mutex_);
   render_state_signal_ = RENDER_STATE_SIGNAL_RUN;
+  cancel_tasks_ = false;
   wait_for_resume_cv_.notify_all();
   wait_for_queue_cv_.notify_all();
 }
@@ -56,6 +100,7 @@ void Renderer::ResumeWorkers() {
 void Renderer::StopWorkers() {
   std::unique_lock<std::mutex> lock(task_queue_mutex_);
   render_state_signal_ = RENDER_STATE_SIGNAL_EXIT;
+  cancel_tasks_ = true;
   wait_for_resume_cv_.notify_all();
   wait_for_queue_cv_.notify_all();
   if (num_exited_thread_ != worker_threads_.size()) {
@@ -66,26 +111,84 @@ void Renderer::StopWorkers() {
   }
 }
 
-void Renderer::WorkerThread() {
+void Renderer::WorkerThread(uint32_t group_index) {
   LAND_TRACE("Worker thread started.");
+  if (!worker_groups_[group_index].cpus.empty() &&
+      !PinCurrentThreadToCpus(worker_groups_[group_index].cpus)) {
+    LAND_WARN("Failed to pin worker of group {}.", group_index);
+  }
   TaskInfo my_task{};
+  int my_num_samples = 0;
+  int my_queue_index = 0;
+  uint32_t my_epoch = 0;
+  std::shared_ptr<const Scene> my_scene;
+  std::shared_ptr<const Scene> retired_scene;
   std::unique_lock<std::mutex> lock(task_queue_mutex_);
   lock.unlock();
   std::vector<glm::vec3> sample_result;
-  PathTracer path_tracer(&renderer_settings_, &scene_); // each thread has its own path tracer
+  PathTracer path_tracer(&renderer_settings_, nullptr); // each thread has its own path tracer
+  WavefrontIntegrator wavefront(&renderer_settings_);
+  BdptIntegrator bdpt(&renderer_settings_);
+  PpmIntegrator ppm(&renderer_settings_);
+  std::shared_ptr<PhotonMap> photon_map;
+  std::vector<int> task_samples;
   while (true) {
     lock.lock();
     while (true) {
       if (render_state_signal_ == RENDER_STATE_SIGNAL_RUN) {
-        if (task_queue_.empty()) {
+        UpdateDeadline_();
+        checkpoint_pending_ |= IsCheckpointDue_();
+        if (checkpoint_pending_ && num_working_thread_ == 0) {
+          // Copy under the lock, write without blocking the other workers
+          Checkpoint checkpoint;
+          CaptureCheckpoint_(checkpoint);
+          checkpoint_pending_ = false;
+          last_checkpoint_ = std::chrono::steady_clock::now();
+          wait_for_queue_cv_.notify_all();
+          lock.unlock();
+          if (WriteCheckpoint(checkpoint, renderer_settings_.checkpoint_path)) {
+            LAND_INFO("Renderer: checkpoint written to {}",
+                      renderer_settings_.checkpoint_path);
+          }
+          lock.lock();
+          continue;
+        }
+        my_epoch = accumulation_epoch_;
+        if (!checkpoint_pending_ && !retry_tasks_.empty()) {
+          // Cancelled tiles come first. They are already counted in the
+          // queues, so they are not pushed again. A pending checkpoint holds
+          // them back like the queues, so the snapshot stays consistent
+          my_task = retry_tasks_.back();
+          retry_tasks_.pop_back();
+          my_num_samples = GetTaskSamples_(my_task);
+          my_queue_index = int(group_index);
+          num_working_thread_++;
+          break;
+        }
+        my_queue_index =
+            checkpoint_pending_ ? -1 : SelectTaskQueue_(group_index);
+        if (my_queue_index < 0) {
+          CheckBudgetExhausted_();
           LAND_TRACE("Wait for task.");
           wait_for_queue_cv_.wait(lock);
         } else {
-          my_task = task_queue_.front(); // Get task
-          task_queue_.pop();
+          auto &task_queue = task_queues_[my_queue_index];
+          my_task = task_queue.front(); // Get task
+          task_queue.pop();
+          my_num_samples = GetTaskSamples_(my_task);
           auto push_task = my_task;
-          push_task.sample += renderer_settings_.num_samples;
-          task_queue_.push(push_task);
+          push_task.sample += uint32_t(my_num_samples);
+          task_queue.push(push_task);
+          max_issued_sample_ = std::max(max_issued_sample_, push_task.sample);
+          if (renderer_settings_.adaptive_tiles &&
+              push_task.sample >= next_rebuild_sample_[my_queue_index] &&
+              task_queue.front().sample == push_task.sample) {
+            // A new pass starts, re-tile with the costs of the passes so far.
+            // Rebuild less often as the cost map settles.
+            RebuildTasks_(my_queue_index, push_task.sample);
+            next_rebuild_sample_[my_queue_index] = push_task.sample * 2;
+          }
+          num_working_thread_++;
           break;
         }
       } else if (render_state_signal_ == RENDER_STATE_SIGNAL_PAUSE) {
@@ -104,42 +207,353 @@ void Renderer::WorkerThread() {
         return;
       }
     }
+    if (my_scene != scene_snapshots_[group_index]) {
+      retired_scene = std::move(my_scene); // Freed outside the lock
+      my_scene = scene_snapshots_[group_index];
+      path_tracer.SetScene(my_scene.get());
+      wavefront.SetScene(my_scene.get());
+      bdpt.SetScene(my_scene.get());
+      ppm.SetScene(my_scene.get());
+    }
+    photon_map.reset();
+    if (renderer_settings_.integrator == INTEGRATOR_PPM) {
+      photon_map = GetPhotonMap_(my_task.sample);
+    }
     lock.unlock();
+    retired_scene.reset();
+    if (photon_map) {
+      // The first tiles of a pass trace its photons together
+      photon_map->Build(path_tracer);
+      ppm.SetPhotonMap(photon_map.get());
+    }
 
+    auto task_start = std::chrono::steady_clock::now();
     sample_result.resize(my_task.width * my_task.height);
 
-    // Render each pixel in this task
-    for (uint32_t i = 0; i < my_task.height; i++) {
-      for (uint32_t j = 0; j < my_task.width; j++) {
-        uint32_t id = i * my_task.width + j;
-        uint32_t x = j + my_task.x;
-        uint32_t y = i + my_task.y;
-        sample_result[id] = glm::vec3{0.0f};
-        for (int k = 0; k < renderer_settings_.num_samples; k++) {
-          glm::vec3 result;
-          RayGeneration(int(x), int(y), int(my_task.sample) + k, result,
-                        path_tracer);
-          sample_result[id] += result;
+    // Render each pixel in this task. A pause cancels between samples
+    bool cancelled = false;
+    if (renderer_settings_.wavefront &&
+        renderer_settings_.integrator == INTEGRATOR_PATH) {
+      task_samples.resize(my_num_samples);
+      for (int k = 0; k < my_num_samples; k++) {
+        task_samples[k] = GetGlobalSample_(my_task.sample + k);
+      }
+      cancelled = !wavefront.RenderTile(*this, my_task, task_samples,
+                                        cancel_tasks_, sample_result);
+    } else {
+      for (uint32_t i = 0; i < my_task.height && !cancelled; i++) {
+        for (uint32_t j = 0; j < my_task.width && !cancelled; j++) {
+          uint32_t id = i * my_task.width + j;
+          uint32_t x = j + my_task.x;
+          uint32_t y = i + my_task.y;
+          sample_result[id] = glm::vec3{0.0f};
+          for (int k = 0; k < my_num_samples; k++) {
+            if (cancel_tasks_.load(std::memory_order_relaxed)) {
+              cancelled = true;
+              break;
+            }
+            glm::vec3 result;
+            if (renderer_settings_.integrator == INTEGRATOR_BDPT) {
+              RayGeneration(int(x), int(y),
+                            GetGlobalSample_(my_task.sample + k), result, bdpt);
+            } else if (photon_map) {
+              RayGeneration(int(x), int(y),
+                            GetGlobalSample_(my_task.sample + k), result, ppm);
+            } else {
+              RayGeneration(int(x), int(y),
+                            GetGlobalSample_(my_task.sample + k), result,
+                            path_tracer);
+            }
+            sample_result[id] += result;
+          }
+          //LAND_INFO("Finished pixel ({},{}). Total {}x{}.", i, j, my_task.height, my_task.width);
         }
-        //LAND_INFO("Finished pixel ({},{}). Total {}x{}.", i, j, my_task.height, my_task.width);
       }
     }
 
+    float task_seconds = std::chrono::duration<float>(
+                             std::chrono::steady_clock::now() - task_start)
+                             .count();
+
     lock.lock();
-    for (uint32_t i = 0; i < my_task.height; i++) {
-      for (uint32_t j = 0; j < my_task.width; j++) {
-        uint32_t id = i * my_task.width + j;
-        uint32_t accumulation_id = (my_task.y + i) * width_ + (my_task.x + j);
-        accumulation_color_[accumulation_id] +=
-            glm::vec4{sample_result[id], 1.0f};
-        accumulation_number_[accumulation_id] +=
-            float(renderer_settings_.num_samples);
+    if (cancelled) {
+      // Discard the partial tile and render it again, with the same samples
+      if (my_epoch == accumulation_epoch_) {
+        retry_tasks_.push_back(my_task);
+      }
+      num_working_thread_--;
+      lock.unlock();
+      continue;
+    }
+    RecordTaskCost_(my_task, my_num_samples, task_seconds);
+    // Drop the result if the accumulation was reset while rendering it
+    if (my_epoch == accumulation_epoch_) {
+      BeginWriteRows_(my_task.y, my_task.y + my_task.height);
+      for (uint32_t i = 0; i < my_task.height; i++) {
+        for (uint32_t j = 0; j < my_task.width; j++) {
+          uint32_t id = i * my_task.width + j;
+          uint32_t accumulation_id = (my_task.y + i) * width_ + (my_task.x + j);
+          accumulation_color_[accumulation_id] +=
+              glm::vec4{sample_result[id], 1.0f};
+          accumulation_number_[accumulation_id] += float(my_num_samples);
+        }
       }
+      EndWriteRows_(my_task.y, my_task.y + my_task.height);
+      MarkDirty_(my_task.x, my_task.x + my_task.width, my_task.y,
+                 my_task.y + my_task.height);
+    }
+    auto &group = worker_groups_[group_index];
+    group.num_samples +=
+        uint64_t(my_task.width) * my_task.height * uint64_t(my_num_samples);
+    if (my_queue_index == int(group_index)) {
+      group.num_local_tasks++;
+    } else {
+      group.num_remote_tasks++;
+    }
+    if (renderer_settings_.numa_stats) {
+      ReportNumaStats_();
+    }
+    num_working_thread_--;
+    CheckBudgetExhausted_();
+    if (IsSampleTargetReached_()) {
+      wait_for_target_cv_.notify_all();
     }
     lock.unlock();
   }
 }
 
+int Renderer::GetGlobalSample_(uint32_t local_sample) const {
+  return int(local_sample * std::max(renderer_settings_.sample_partition_count, 1u) +
+             renderer_settings_.sample_partition_index);
+}
+
+void Renderer::UpdateDeadline_() {
+  if (renderer_settings_.time_budget <= 0.0f || deadline_reached_) {
+    return;
+  }
+  float elapsed = std::chrono::duration<float>(
+                      std::chrono::steady_clock::now() - render_start_)
+                      .count();
+  bool stop = elapsed >= renderer_settings_.time_budget;
+  int queue_index = SelectTaskQueue_(0);
+  uint32_t num_samples = std::max(renderer_settings_.num_samples, 1);
+  if (!stop && queue_index >= 0 &&
+      task_queues_[queue_index].front().sample >= max_issued_sample_ &&
+      max_issued_sample_ >= num_samples) {
+    // The next task starts a new pass. Estimate its length by the average
+    // length of the passes so far, and skip it if it would overrun.
+    float pass_time = elapsed / float(max_issued_sample_ / num_samples);
+    stop = elapsed + pass_time > renderer_settings_.time_budget;
+  }
+  if (stop) {
+    deadline_reached_ = true;
+    deadline_sample_ = max_issued_sample_;
+  }
+}
+
+void Renderer::CheckBudgetExhausted_() {
+  if (!deadline_reached_ || budget_exhausted_ || num_working_thread_ > 0 ||
+      !retry_tasks_.empty() || SelectTaskQueue_(0) >= 0) {
+    return;
+  }
+  budget_exhausted_ = true;
+  LAND_INFO("Renderer: time budget of {}s exhausted after {:.2f}s, {} spp",
+            renderer_settings_.time_budget,
+            std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                         render_start_)
+                .count(),
+            deadline_sample_);
+}
+
+bool Renderer::IsSampleTargetReached_() const {
+  if (!renderer_settings_.sample_target || num_working_thread_ > 0 ||
+      !retry_tasks_.empty()) {
+    return false;
+  }
+  bool has_tasks = false;
+  for (auto &task_queue : task_queues_) {
+    if (!task_queue.empty()) {
+      has_tasks = true;
+      if (task_queue.front().sample < renderer_settings_.sample_target) {
+        return false;
+      }
+    }
+  }
+  return has_tasks;
+}
+
+int Renderer::GetTaskSamples_(const TaskInfo &task) const {
+  int num_samples = renderer_settings_.num_samples;
+  if (renderer_settings_.sample_target) {
+    num_samples = std::min(
+        num_samples, int(renderer_settings_.sample_target - task.sample));
+  }
+  return num_samples;
+}
+
+void Renderer::RestartBudget_() {
+  render_start_ = std::chrono::steady_clock::now();
+  max_issued_sample_ = 0;
+  deadline_sample_ = 0;
+  deadline_reached_ = false;
+  budget_exhausted_ = false;
+}
+
+int Renderer::SelectTaskQueue_(uint32_t group_index) const {
+  int lagging_index = -1;
+  for (int i = 0; i < int(task_queues_.size()); i++) {
+    if (!task_queues_[i].empty() &&
+        (lagging_index < 0 || task_queues_[i].front().sample <
+                                  task_queues_[lagging_index].front().sample)) {
+      lagging_index = i;
+    }
+  }
+  if (lagging_index >= 0 && deadline_reached_ &&
+      task_queues_[lagging_index].front().sample >= deadline_sample_) {
+    return -1; // Every tile is issued up to the deadline spp
+  }
+  if (lagging_index >= 0 && renderer_settings_.sample_target &&
+      task_queues_[lagging_index].front().sample >=
+          renderer_settings_.sample_target) {
+    return -1; // Every tile is issued up to the target spp
+  }
+  auto &own_queue = task_queues_[group_index];
+  if (!own_queue.empty() && (lagging_index < 0 ||
+                             own_queue.front().sample <=
+                                 task_queues_[lagging_index].front().sample)) {
+    return int(group_index);
+  }
+  return lagging_index;
+}
+
+bool Renderer::IsCheckpointDue_() const {
+  return renderer_settings_.checkpoint_interval > 0.0f &&
+         !renderer_settings_.checkpoint_path.empty() && !budget_exhausted_ &&
+         std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                      last_checkpoint_)
+                 .count() >= renderer_settings_.checkpoint_interval;
+}
+
+void Renderer::CaptureCheckpoint_(Checkpoint &checkpoint) const {
+  checkpoint.width = width_;
+  checkpoint.height = height_;
+  checkpoint.tasks.clear();
+  for (auto task_queue : task_queues_) { // Copy, std::queue can not be iterated
+    while (!task_queue.empty()) {
+      checkpoint.tasks.push_back(task_queue.front());
+      task_queue.pop();
+    }
+  }
+  checkpoint.retry_tasks = retry_tasks_;
+  checkpoint.accumulation_color.assign(accumulation_color_.begin(),
+                                       accumulation_color_.end());
+  checkpoint.accumulation_number.assign(accumulation_number_.begin(),
+                                        accumulation_number_.end());
+}
+
+bool Renderer::SaveCheckpoint(const std::string &path) {
+  Checkpoint checkpoint;
+  SafeOperation<void>([&]() { CaptureCheckpoint_(checkpoint); });
+  return WriteCheckpoint(checkpoint, path);
+}
+
+bool Renderer::LoadCheckpoint(const std::string &path) {
+  Checkpoint checkpoint;
+  if (!ReadCheckpoint(path, checkpoint)) {
+    return false;
+  }
+  return SafeOperation<bool>([&]() {
+    if (checkpoint.width != width_ || checkpoint.height != height_) {
+      LAND_WARN("Renderer: checkpoint {} is {}x{}, but the image is {}x{}",
+                path, checkpoint.width, checkpoint.height, width_, height_);
+      return false;
+    }
+    BeginWriteRows_(0, height_);
+    std::copy(checkpoint.accumulation_color.begin(),
+              checkpoint.accumulation_color.end(),
+              accumulation_color_.begin());
+    std::copy(checkpoint.accumulation_number.begin(),
+              checkpoint.accumulation_number.end(),
+              accumulation_number_.begin());
+    EndWriteRows_(0, height_);
+    MarkDirty_(0, width_, 0, height_);
+    for (auto &task_queue : task_queues_) {
+      while (!task_queue.empty()) {
+        task_queue.pop();
+      }
+    }
+    uint32_t max_sample = 0;
+    for (auto &task : checkpoint.tasks) {
+      task_queues_[GetGroupOfRow_(task.y)].push(task);
+      max_sample = std::max(max_sample, task.sample);
+    }
+    retry_tasks_ = checkpoint.retry_tasks;
+    accumulation_epoch_++;
+    // The cost map is not stored, re-tile once the next pass was measured
+    next_rebuild_sample_.assign(
+        task_queues_.size(),
+        max_sample + uint32_t(std::max(renderer_settings_.num_samples, 1)));
+    RestartBudget_();
+    max_issued_sample_ = max_sample;
+    last_checkpoint_ = std::chrono::steady_clock::now();
+    LAND_INFO("Renderer: resumed {} tiles from {}", checkpoint.tasks.size(),
+              path);
+    return true;
+  });
+}
+
+void Renderer::ReportNumaStats_() {
+  auto now = std::chrono::steady_clock::now();
+  float seconds =
+      std::chrono::duration<float>(now - last_numa_report_).count();
+  if (seconds < 5.0f) {
+    return;
+  }
+  for (size_t i = 0; i < worker_groups_.size(); i++) {
+    auto &group = worker_groups_[i];
+    uint64_t num_tasks = group.num_local_tasks + group.num_remote_tasks;
+    LAND_INFO(
+        "Renderer: group {} rows [{}, {}): {:.2f} Msamples/s, {:.2f} Msamples/s "
+        "per thread, remote tasks {:.1f}%",
+        i, group.y_begin, group.y_end, float(group.num_samples) / seconds * 1e-6f,
+        float(group.num_samples) / seconds * 1e-6f /
+            float(std::max(group.num_threads, 1u)),
+        num_tasks ? 100.0f * float(group.num_remote_tasks) / float(num_tasks)
+                  : 0.0f);
+    group.num_samples = 0;
+    group.num_local_tasks = 0;
+    group.num_remote_tasks = 0;
+  }
+  last_numa_report_ = now;
+}
+
+std::shared_ptr<PhotonMap> Renderer::GetPhotonMap_(uint32_t sample) {
+  // Tasks still to be issued start no earlier than the front of a queue
+  uint32_t oldest_sample = sample;
+  for (auto &task_queue : task_queues_) {
+    if (!task_queue.empty()) {
+      oldest_sample = std::min(oldest_sample, task_queue.front().sample);
+    }
+  }
+  for (auto &task : retry_tasks_) {
+    oldest_sample = std::min(oldest_sample, task.sample);
+  }
+  // Workers still rendering an older pass keep its map alive
+  photon_maps_.erase(photon_maps_.begin(),
+                     photon_maps_.lower_bound(oldest_sample));
+  auto &photon_map = photon_maps_[sample];
+  if (!photon_map) {
+    // Numbered by global sample, so every process of a distributed render
+    // gives a pass the same radius and photons
+    uint32_t pass = uint32_t(GetGlobalSample_(sample)) /
+                    uint32_t(std::max(renderer_settings_.num_samples, 1));
+    photon_map = std::make_shared<PhotonMap>(
+        &renderer_settings_, pass,
+        PpmIntegrator::GetPassRadius(renderer_settings_.photon_radius, pass));
+  }
+  return photon_map;
+}
+
 RenderStateSignal Renderer::GetRenderStateSignal() const {
   return render_state_signal_;
 }
@@ -148,55 +562,392 @@ void Renderer::Resize(uint32_t width, uint32_t height) {
   SafeOperation<void>([&]() {
     width_ = width;
     height_ = height;
+    // Free the old buffers first. Growing in place would copy them on this
+    // thread, and shrinking would keep pages on the nodes of the old bands
+    decltype(accumulation_number_)().swap(accumulation_number_);
+    decltype(accumulation_color_)().swap(accumulation_color_);
     accumulation_number_.resize(width_ * height_);
     accumulation_color_.resize(width_ * height_);
+    num_row_blocks_ = (height_ + kSeqlockRows - 1) / kSeqlockRows;
+    row_block_versions_ =
+        std::make_unique<std::atomic<uint32_t>[]>(num_row_blocks_);
+    row_block_dirty_ =
+        std::make_unique<std::atomic<uint64_t>[]>(num_row_blocks_);
+    for (uint32_t i = 0; i < num_row_blocks_; i++) {
+      row_block_versions_[i] = 0;
+      row_block_dirty_[i] = uint64_t(width_); // Everything is new
+    }
+    AssignGroupRows_();
     // Clear accumulation number and color
-    std::memset(accumulation_number_.data(), 0,
-                sizeof(float) * accumulation_number_.size());
-    std::memset(accumulation_color_.data(), 0,
-                sizeof(glm::vec4) * accumulation_color_.size());
-    while (!task_queue_.empty()) {
-      task_queue_.pop();
-    }
-    // Split the rendering task. Each task contains a 4x4 pixel
-    const uint32_t task_width = 4;
-    const uint32_t task_height = 4;
-    std::vector<TaskInfo> task_list;
-    for (int i = 0; i < (width_ + task_width - 1) / task_width; i++) {
-      for (int j = 0; j < (height_ + task_height - 1) / task_height; j++) {
-        TaskInfo task_info{};
-        task_info.x = i * task_width;
-        task_info.y = j * task_height;
-        task_info.width = std::min(task_width, width_ - task_info.x);
-        task_info.height = std::min(task_height, height_ - task_info.y);
-        task_info.sample = 0;
-        task_list.push_back(task_info);
+    FirstTouchAccumulation_();
+    num_cell_columns_ = (width_ + kCostCellSize - 1) / kCostCellSize;
+    num_cell_rows_ = (height_ + kCostCellSize - 1) / kCostCellSize;
+    cell_costs_.assign(num_cell_columns_ * num_cell_rows_, 0.0f);
+    retry_tasks_.clear();
+    BuildInitialTasks_();
+    RestartBudget_();
+  });
+}
+
+void Renderer::BuildInitialTasks_() {
+  for (auto &task_queue : task_queues_) {
+    while (!task_queue.empty()) {
+      task_queue.pop();
+    }
+  }
+  // Split the rendering task into square tiles
+  const uint32_t tile_size = GetInitialTileSize_();
+  std::vector<std::pair<float, TaskInfo>> tiles;
+  for (uint32_t y = 0; y < height_; y += tile_size) {
+    for (uint32_t x = 0; x < width_; x += tile_size) {
+      TaskInfo task_info{};
+      task_info.x = x;
+      task_info.y = y;
+      task_info.width = std::min(tile_size, width_ - x);
+      // Tiles do not cross the rows of a worker group
+      task_info.height = std::min(
+          tile_size, worker_groups_[GetGroupOfRow_(y)].y_end - y);
+      task_info.sample = 0;
+      tiles.emplace_back(0.0f, task_info);
+      // Band boundaries are 4-aligned, continue with the rest of the tile
+      for (uint32_t rest_y = y + task_info.height;
+           rest_y < std::min(y + tile_size, height_);
+           rest_y += task_info.height) {
+        task_info.y = rest_y;
+        task_info.height =
+            std::min(y + tile_size, worker_groups_[GetGroupOfRow_(rest_y)].y_end) -
+            rest_y;
+        tiles.emplace_back(0.0f, task_info);
       }
     }
+  }
+  OrderTiles_(tiles);
+  for (auto &tile : tiles) {
+    task_queues_[GetGroupOfRow_(tile.second.y)].push(tile.second);
+  }
+  LAND_INFO("Renderer: {} tiles of {}x{} pixels", tiles.size(), tile_size,
+            tile_size);
+  next_rebuild_sample_.assign(task_queues_.size(),
+                              uint32_t(std::max(renderer_settings_.num_samples, 1)));
+}
+
+uint32_t Renderer::GetInitialTileSize_() const {
+  if (renderer_settings_.tile_size > 0) {
+    uint32_t tile_size = kCostCellSize;
+    while (tile_size < uint32_t(renderer_settings_.tile_size) &&
+           tile_size < kMaxTileSize) {
+      tile_size *= 2;
+    }
+    return tile_size;
+  }
+  // Largest tiles that still give every thread enough tasks per pass
+  uint32_t num_threads = 0;
+  for (auto &group : worker_groups_) {
+    num_threads += group.num_threads;
+  }
+  if (!num_threads) { // Workers not started yet
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  uint32_t tile_size = kMaxTileSize;
+  while (tile_size > kCostCellSize &&
+         uint64_t((width_ + tile_size - 1) / tile_size) *
+                 ((height_ + tile_size - 1) / tile_size) <
+             uint64_t(num_threads) * kTasksPerThread) {
+    tile_size /= 2;
+  }
+  return tile_size;
+}
+
+void Renderer::OrderTiles_(std::vector<std::pair<float, TaskInfo>> &tiles) const {
+  if (renderer_settings_.tile_order == TILE_ORDER_RANDOM) {
     std::random_device rd;
     std::mt19937 g(rd());
-    std::shuffle(task_list.begin(), task_list.end(), g);
-    for (auto &task : task_list) {
-      task_queue_.push(task);
+    std::shuffle(tiles.begin(), tiles.end(), g);
+    return;
+  }
+  // Tiles are disjoint and aligned, so any cell of a tile gives its position
+  // along the curve. Use the top-left one.
+  uint32_t curve_size = 1;
+  while (curve_size < std::max(num_cell_columns_, num_cell_rows_)) {
+    curve_size *= 2;
+  }
+  bool morton = renderer_settings_.tile_order == TILE_ORDER_MORTON;
+  auto curve_index = [curve_size, morton](const TaskInfo &task) {
+    uint32_t cx = task.x / kCostCellSize;
+    uint32_t cy = task.y / kCostCellSize;
+    return morton ? MortonIndex(cx, cy) : HilbertIndex(curve_size, cx, cy);
+  };
+  std::sort(tiles.begin(), tiles.end(),
+            [&curve_index](const std::pair<float, TaskInfo> &a,
+                           const std::pair<float, TaskInfo> &b) {
+              return curve_index(a.second) < curve_index(b.second);
+            });
+  if (renderer_settings_.tile_order == TILE_ORDER_COST) {
+    // Longest tiles first, so the cheap ones fill the gaps at the end of a pass
+    std::stable_sort(tiles.begin(), tiles.end(),
+                     [](const std::pair<float, TaskInfo> &a,
+                        const std::pair<float, TaskInfo> &b) {
+                       return a.first > b.first;
+                     });
+  }
+}
+
+void Renderer::RecordTaskCost_(const TaskInfo &task,
+                               int num_samples,
+                               float seconds) {
+  if (cell_costs_.empty() || task.width == 0 || task.height == 0 ||
+      num_samples <= 0) {
+    return;
+  }
+  float cost =
+      seconds / float(task.width * task.height * uint32_t(num_samples));
+  uint32_t cx_end = (task.x + task.width + kCostCellSize - 1) / kCostCellSize;
+  uint32_t cy_end = (task.y + task.height + kCostCellSize - 1) / kCostCellSize;
+  for (uint32_t cy = task.y / kCostCellSize; cy < cy_end; cy++) {
+    for (uint32_t cx = task.x / kCostCellSize; cx < cx_end; cx++) {
+      float &cell_cost = cell_costs_[cy * num_cell_columns_ + cx];
+      // Exponential moving average, so the map follows camera changes
+      cell_cost = cell_cost == 0.0f ? cost : 0.5f * (cell_cost + cost);
     }
-  });
+  }
+}
+
+float Renderer::GetBlockCost_(uint32_t x,
+                              uint32_t y,
+                              uint32_t width,
+                              uint32_t height) const {
+  float cost = 0.0f;
+  for (uint32_t cy = y / kCostCellSize;
+       cy < (y + height + kCostCellSize - 1) / kCostCellSize; cy++) {
+    uint32_t cell_height =
+        std::min(kCostCellSize, height_ - cy * kCostCellSize);
+    for (uint32_t cx = x / kCostCellSize;
+         cx < (x + width + kCostCellSize - 1) / kCostCellSize; cx++) {
+      uint32_t cell_width = std::min(kCostCellSize, width_ - cx * kCostCellSize);
+      cost += cell_costs_[cy * num_cell_columns_ + cx] *
+              float(cell_width * cell_height);
+    }
+  }
+  return cost;
+}
+
+void Renderer::SplitTile_(uint32_t x,
+                          uint32_t y,
+                          uint32_t size,
+                          uint32_t y_end,
+                          uint32_t sample,
+                          float target_cost,
+                          std::vector<std::pair<float, TaskInfo>> &tiles) const {
+  if (x >= width_ || y >= y_end) {
+    return;
+  }
+  TaskInfo task{};
+  task.x = x;
+  task.y = y;
+  task.width = std::min(size, width_ - x);
+  task.height = std::min(size, y_end - y);
+  task.sample = sample;
+  float cost = GetBlockCost_(task.x, task.y, task.width, task.height);
+  if (cost > target_cost && size > kCostCellSize) {
+    uint32_t half = size / 2;
+    SplitTile_(x, y, half, y_end, sample, target_cost, tiles);
+    SplitTile_(x + half, y, half, y_end, sample, target_cost, tiles);
+    SplitTile_(x, y + half, half, y_end, sample, target_cost, tiles);
+    SplitTile_(x + half, y + half, half, y_end, sample, target_cost, tiles);
+    return;
+  }
+  tiles.emplace_back(cost, task);
+}
+
+void Renderer::RebuildTasks_(uint32_t queue_index, uint32_t sample) {
+  auto &group = worker_groups_[queue_index];
+  if (group.y_begin >= group.y_end) {
+    return;
+  }
+  // Cells still in flight have no measurement yet, use the mean of the band
+  uint32_t cy_begin = group.y_begin / kCostCellSize;
+  uint32_t cy_end = (group.y_end + kCostCellSize - 1) / kCostCellSize;
+  float measured_cost = 0.0f;
+  uint32_t num_measured = 0;
+  for (uint32_t i = cy_begin * num_cell_columns_;
+       i < cy_end * num_cell_columns_; i++) {
+    if (cell_costs_[i] > 0.0f) {
+      measured_cost += cell_costs_[i];
+      num_measured++;
+    }
+  }
+  if (!num_measured) {
+    return;
+  }
+  float mean_cost = measured_cost / float(num_measured);
+  for (uint32_t i = cy_begin * num_cell_columns_;
+       i < cy_end * num_cell_columns_; i++) {
+    if (cell_costs_[i] == 0.0f) {
+      cell_costs_[i] = mean_cost;
+    }
+  }
+
+  float band_cost = GetBlockCost_(0, group.y_begin, width_,
+                                  group.y_end - group.y_begin);
+  float target_cost =
+      band_cost / float(std::max(group.num_threads, 1u) * kTasksPerThread);
+  std::vector<std::pair<float, TaskInfo>> tiles;
+  for (uint32_t y = group.y_begin; y < group.y_end; y += kMaxTileSize) {
+    for (uint32_t x = 0; x < width_; x += kMaxTileSize) {
+      SplitTile_(x, y, kMaxTileSize, group.y_end, sample, target_cost, tiles);
+    }
+  }
+  OrderTiles_(tiles);
+  auto &task_queue = task_queues_[queue_index];
+  while (!task_queue.empty()) {
+    task_queue.pop();
+  }
+  for (auto &tile : tiles) {
+    task_queue.push(tile.second);
+  }
+}
+
+void Renderer::AssignGroupRows_() {
+  // Bands are aligned to the 4-pixel task height, so no task crosses a band
+  const uint32_t row_alignment = 4;
+  uint32_t total_threads = 0;
+  for (auto &group : worker_groups_) {
+    total_threads += std::max(group.num_threads, 1u);
+  }
+  uint32_t num_blocks = (height_ + row_alignment - 1) / row_alignment;
+  uint32_t assigned_threads = 0;
+  for (auto &group : worker_groups_) {
+    group.y_begin = std::min(
+        height_, num_blocks * assigned_threads / total_threads * row_alignment);
+    assigned_threads += std::max(group.num_threads, 1u);
+    group.y_end = std::min(
+        height_, num_blocks * assigned_threads / total_threads * row_alignment);
+  }
+}
+
+uint32_t Renderer::GetGroupOfRow_(uint32_t y) const {
+  for (uint32_t i = 0; i < worker_groups_.size(); i++) {
+    if (y < worker_groups_[i].y_end) {
+      return i;
+    }
+  }
+  return uint32_t(worker_groups_.size() - 1);
+}
+
+void Renderer::FirstTouchAccumulation_() {
+  auto clear_rows = [this](uint32_t y_begin, uint32_t y_end) {
+    std::memset(accumulation_number_.data() + y_begin * width_, 0,
+                sizeof(float) * (y_end - y_begin) * width_);
+    std::memset(accumulation_color_.data() + y_begin * width_, 0,
+                sizeof(glm::vec4) * (y_end - y_begin) * width_);
+  };
+  if (worker_groups_.size() == 1) {
+    clear_rows(0, height_);
+    return;
+  }
+  // Pages are placed on the node of the thread that writes them first
+  std::vector<std::thread> touch_threads;
+  for (auto &group : worker_groups_) {
+    touch_threads.emplace_back([&group, &clear_rows]() {
+      PinCurrentThreadToCpus(group.cpus);
+      clear_rows(group.y_begin, group.y_end);
+    });
+  }
+  for (auto &touch_thread : touch_threads) {
+    touch_thread.join();
+  }
+}
+
+std::vector<std::shared_ptr<const Scene>> Renderer::CreateSnapshots_() {
+  auto snapshot = std::make_shared<Scene>(scene_);
+  snapshot->UpdateBsdfs(); // Materials may have been edited
+  snapshot->GetLights().SetSampling(renderer_settings_.light_sampling);
+  if (worker_groups_.size() == 1) {
+    model_replicas_.clear();
+    return {snapshot};
+  }
+  // Pages are placed on the node of the thread that writes them first, so
+  // each group copies the scene and clones the meshes and BVHs it reads
+  model_replicas_.resize(worker_groups_.size());
+  std::vector<std::shared_ptr<const Scene>> snapshots(worker_groups_.size());
+  std::vector<std::thread> copy_threads;
+  for (size_t i = 0; i < worker_groups_.size(); i++) {
+    copy_threads.emplace_back([this, i, &snapshot, &snapshots]() {
+      PinCurrentThreadToCpus(worker_groups_[i].cpus);
+      auto replica = std::make_shared<Scene>(*snapshot);
+      auto &replicas = model_replicas_[i];
+      std::map<const Model *, ModelReplica> used_replicas;
+      for (auto &entity : replica->GetEntities()) {
+        std::shared_ptr<const Model> original = entity.GetSharedModel();
+        auto it = replicas.find(original.get());
+        if (it == replicas.end()) {
+          it = replicas
+                   .emplace(original.get(),
+                            ModelReplica{original, original->Clone()})
+                   .first;
+        }
+        used_replicas.insert(*it);
+        entity.SetModel(it->second.replica);
+      }
+      replicas.swap(used_replicas); // Models removed from scene_ are freed
+      snapshots[i] = std::move(replica);
+    });
+  }
+  for (auto &copy_thread : copy_threads) {
+    copy_thread.join();
+  }
+  return snapshots;
 }
 
 void Renderer::ResetAccumulation() {
-  SafeOperation<void>([&]() {
-    std::memset(accumulation_number_.data(), 0,
-                sizeof(float) * accumulation_number_.size());
-    std::memset(accumulation_color_.data(), 0,
-                sizeof(glm::vec4) * accumulation_color_.size());
-    if (task_queue_.back().sample) {
-      for (int i = 0; i < task_queue_.size(); i++) {
-        auto task = task_queue_.front();
-        task_queue_.pop();
+  // Copy outside the lock. The old snapshots are released after the lock
+  auto snapshots = CreateSnapshots_();
+  std::unique_lock<std::mutex> lock(task_queue_mutex_);
+  scene_snapshots_.swap(snapshots);
+  accumulation_epoch_++;
+  retry_tasks_.clear();
+  photon_maps_.clear();
+  BeginWriteRows_(0, height_);
+  std::memset(accumulation_number_.data(), 0,
+              sizeof(float) * accumulation_number_.size());
+  std::memset(accumulation_color_.data(), 0,
+              sizeof(glm::vec4) * accumulation_color_.size());
+  EndWriteRows_(0, height_);
+  MarkDirty_(0, width_, 0, height_);
+  for (auto &task_queue : task_queues_) {
+    if (!task_queue.empty() && task_queue.back().sample) {
+      for (size_t i = 0; i < task_queue.size(); i++) {
+        auto task = task_queue.front();
+        task_queue.pop();
         task.sample = 0;
-        task_queue_.push(task);
+        task_queue.push(task);
       }
     }
-  });
+  }
+  // Keep the tiles and cost map, but re-tile after the first pass again
+  next_rebuild_sample_.assign(
+      task_queues_.size(),
+      uint32_t(std::max(renderer_settings_.num_samples, 1)));
+  RestartBudget_();
+}
+
+void Renderer::GeneratePrimaryRay(int x,
+                                  int y,
+                                  int sample,
+                                  const Scene &scene,
+                                  glm::vec3 *origin,
+                                  glm::vec3 *direction,
+                                  float *time,
+                                  Sampler *sampler) const {
+  sampler->StartSample(uint32_t(x), uint32_t(y), uint32_t(sample));
+  glm::vec2 range_low{float(x) / float(width_), float(y) / float(height_)};
+  glm::vec2 range_high{(float(x) + 1.0f) / float(width_),
+                       (float(y) + 1.0f) / float(height_)};
+  scene.GetCamera().GenerateRay(
+      float(width_) / float(height_), range_low, range_high, *origin, *direction, time, *sampler);
+  auto camera_to_world = scene.GetCameraToWorld();
+  *origin = camera_to_world * glm::vec4(*origin, 1.0f);
+  *direction = camera_to_world * glm::vec4(*direction, 0.0f);
 }
 
 void Renderer::RayGeneration(int x,
@@ -204,40 +955,133 @@ void Renderer::RayGeneration(int x,
                              int sample,
                              glm::vec3 &color_result,
                              PathTracer &path_tracer) const {
-  std::mt19937 xrd(x); // random number generator, here x is seed
-  std::mt19937 yrd(y + std::uniform_int_distribution<int>()(xrd)); // uniform distribution of int, no range, generate by xrd
-  std::mt19937 rd(sample + std::uniform_int_distribution<int>()(yrd));
-  glm::vec2 pos{(float(x) + 0.5f) / float(width_),
-                (float(y) + 0.5f) / float(height_)};
-  glm::vec2 range_low{float(x) / float(width_), float(y) / float(height_)};
-  glm::vec2 range_high{(float(x) + 1.0f) / float(width_),
-                       (float(y) + 1.0f) / float(height_)};
   glm::vec3 origin, direction;
   float time;
-  scene_.GetCamera().GenerateRay(
-      float(width_) / float(height_), range_low, range_high, origin, direction, &time, rd);
-  //scene_.GetCamera().GenerateRay(
-  //  float(width_) / float(height_), range_low, range_high, origin, direction, rd);
-  auto camera_to_world = scene_.GetCameraToWorld();
-  origin = camera_to_world * glm::vec4(origin, 1.0f);
-  direction = camera_to_world * glm::vec4(direction, 0.0f);
-  //color_result = path_tracer.SampleRay(origin, direction, x, y, sample); // Get the color of a sample ray
-  path_tracer.SetSeed(std::uniform_int_distribution<int>()(rd)); // set the random seed of path tracer
+  GeneratePrimaryRay(x, y, sample, *path_tracer.GetScene(), &origin, &direction,
+                     &time, &path_tracer.GetSampler());
   color_result = path_tracer.SampleRayPathTrace(origin, direction, time);
-  //color_result = path_tracer.SampleRayPathTrace(origin, direction, 0.0f);
-  //if ((x % (width_ / 100) == 0) && (y % (height_ / 100) == 0)) {
-  //  LAND_INFO("Pixel ({},{}), color {}", x, y, glm::to_string(color_result));
-  //}
+}
+
+void Renderer::RayGeneration(int x,
+                             int y,
+                             int sample,
+                             glm::vec3 &color_result,
+                             BdptIntegrator &bdpt) const {
+  glm::vec3 origin, direction;
+  float time;
+  GeneratePrimaryRay(x, y, sample, *bdpt.GetScene(), &origin, &direction,
+                     &time, &bdpt.GetSampler());
+  color_result = bdpt.SampleRay(origin, direction, time);
+}
+
+void Renderer::RayGeneration(int x,
+                             int y,
+                             int sample,
+                             glm::vec3 &color_result,
+                             PpmIntegrator &ppm) const {
+  glm::vec3 origin, direction;
+  float time;
+  GeneratePrimaryRay(x, y, sample, *ppm.GetScene(), &origin, &direction,
+                     &time, &ppm.GetSampler());
+  color_result = ppm.SampleRay(origin, direction, time);
+}
+
+void Renderer::BeginWriteRows_(uint32_t y_begin, uint32_t y_end) {
+  for (uint32_t i = y_begin / kSeqlockRows;
+       i < (y_end + kSeqlockRows - 1) / kSeqlockRows; i++) {
+    row_block_versions_[i].store(
+        row_block_versions_[i].load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Renderer::EndWriteRows_(uint32_t y_begin, uint32_t y_end) {
+  for (uint32_t i = y_begin / kSeqlockRows;
+       i < (y_end + kSeqlockRows - 1) / kSeqlockRows; i++) {
+    row_block_versions_[i].store(
+        row_block_versions_[i].load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
+  }
+}
+
+void Renderer::MarkDirty_(uint32_t x_begin,
+                          uint32_t x_end,
+                          uint32_t y_begin,
+                          uint32_t y_end) {
+  for (uint32_t i = y_begin / kSeqlockRows;
+       i < (y_end + kSeqlockRows - 1) / kSeqlockRows; i++) {
+    uint64_t columns = row_block_dirty_[i].load(std::memory_order_relaxed);
+    uint64_t merged;
+    do {
+      merged = uint64_t(std::min(uint32_t(columns >> 32), x_begin)) << 32 |
+               std::max(uint32_t(columns), x_end);
+    } while (!row_block_dirty_[i].compare_exchange_weak(
+        columns, merged, std::memory_order_release,
+        std::memory_order_relaxed));
+  }
+}
+
+void Renderer::CopyRowBlock_(uint32_t block,
+                             uint32_t x_begin,
+                             uint32_t x_end,
+                             glm::vec4 *accumulation_color_buffer_dst,
+                             float *accumulation_number_buffer_dst) const {
+  uint32_t y_begin = block * kSeqlockRows;
+  uint32_t y_end = std::min(y_begin + kSeqlockRows, height_);
+  size_t count = x_end - x_begin;
+  while (true) {
+    uint32_t version =
+        row_block_versions_[block].load(std::memory_order_acquire);
+    if (version & 1u) {
+      std::this_thread::yield(); // A worker is adding to this block
+      continue;
+    }
+    for (uint32_t y = y_begin; y < y_end; y++) {
+      size_t offset = size_t(y) * width_ + x_begin;
+      std::memcpy(accumulation_color_buffer_dst + offset,
+                  accumulation_color_.data() + offset,
+                  sizeof(glm::vec4) * count);
+      std::memcpy(accumulation_number_buffer_dst + offset,
+                  accumulation_number_.data() + offset, sizeof(float) * count);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (row_block_versions_[block].load(std::memory_order_relaxed) ==
+        version) {
+      return;
+    }
+  }
 }
 
 void Renderer::RetrieveAccumulationResult(
     glm::vec4 *accumulation_color_buffer_dst,
     float *accumulation_number_buffer_dst) {
-  std::unique_lock<std::mutex> lock(task_queue_mutex_);
-  std::memcpy(accumulation_color_buffer_dst, accumulation_color_.data(),
-              sizeof(glm::vec4) * accumulation_color_.size());
-  std::memcpy(accumulation_number_buffer_dst, accumulation_number_.data(),
-              sizeof(float) * accumulation_number_.size());
+  for (uint32_t i = 0; i < num_row_blocks_; i++) {
+    CopyRowBlock_(i, 0, width_, accumulation_color_buffer_dst,
+                  accumulation_number_buffer_dst);
+  }
+}
+
+std::vector<ImageRegion> Renderer::RetrieveAccumulationUpdate(
+    glm::vec4 *accumulation_color_buffer_dst,
+    float *accumulation_number_buffer_dst) {
+  std::vector<ImageRegion> regions;
+  for (uint32_t i = 0; i < num_row_blocks_; i++) {
+    // Take the range before copying, so later writes mark the block again
+    uint64_t columns =
+        row_block_dirty_[i].exchange(kCleanColumns, std::memory_order_acquire);
+    uint32_t x_begin = uint32_t(columns >> 32);
+    uint32_t x_end = std::min(uint32_t(columns), width_);
+    if (x_begin >= x_end) {
+      continue;
+    }
+    CopyRowBlock_(i, x_begin, x_end, accumulation_color_buffer_dst,
+                  accumulation_number_buffer_dst);
+    uint32_t y = i * kSeqlockRows;
+    regions.push_back(
+        {x_begin, y, x_end - x_begin, std::min(kSeqlockRows, height_ - y)});
+  }
+  return regions;
 }
 
 bool Renderer::IsPaused() const {
@@ -245,30 +1089,59 @@ bool Renderer::IsPaused() const {
 }
 
 int Renderer::LoadTexture(const std::string &file_path) {
-  return SafeOperation<int>([&]() { return scene_.LoadTexture(file_path); });
+  return scene_.LoadTexture(file_path); // Unused until a material refers to it
 }
 
 int Renderer::LoadObjMesh(const std::string &file_path) {
-  return SafeOperation<int>([&]() { return scene_.LoadObjMesh(file_path); });
+  int entity_id = scene_.LoadObjMesh(file_path);
+  ResetAccumulation();
+  return entity_id;
+}
+
+bool Renderer::IsBudgetExhausted() {
+  std::unique_lock<std::mutex> lock(task_queue_mutex_);
+  return budget_exhausted_;
+}
+
+bool Renderer::WaitForSampleTarget(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(task_queue_mutex_);
+  return wait_for_target_cv_.wait_for(
+      lock, timeout, [this] { return IsSampleTargetReached_(); });
 }
 
 int Renderer::GetAccumulatedSamples() {
   std::unique_lock<std::mutex> lock(task_queue_mutex_);
-  return task_queue_.front().sample;
+  // Every pixel has at least the samples of the most lagging queue. Not
+  // SelectTaskQueue_, which finds no queue once the deadline is reached
+  int samples = -1;
+  for (auto &task_queue : task_queues_) {
+    if (!task_queue.empty() &&
+        (samples < 0 || int(task_queue.front().sample) < samples)) {
+      samples = int(task_queue.front().sample);
+    }
+  }
+  samples = std::max(samples, 0);
+  if (deadline_reached_) {
+    samples = std::min(samples, int(deadline_sample_));
+  }
+  for (auto &task : retry_tasks_) {
+    samples = std::min(samples, int(task.sample));
+  }
+  return samples;
 }
 
 void Renderer::LoadScene(const std::string &file_path) {
-  SafeOperation<void>([&]() { scene_ = Scene(file_path); });
+  scene_ = Scene(file_path);
+  ResetAccumulation();
 }
 
 std::vector<glm::vec4> Renderer::CaptureRenderedImage() {
   std::vector<glm::vec4> result(width_ * height_);
-  SafeOperation<void>([&result, this]() {
-    for (int i = 0; i < width_ * height_; i++) {
-      result[i] = accumulation_color_[i] /
-                  float(std::max(1.0f, accumulation_number_[i]));
-    }
-  });
+  std::vector<float> number(width_ * height_);
+  RetrieveAccumulationResult(result.data(), number.data());
+  for (uint32_t i = 0; i < width_ * height_; i++) {
+    result[i] /= float(std::max(1.0f, number[i]));
+  }
   return result;
 }
 
@@ -1,9 +1,16 @@
 #pragma once
+#include "atomic"
+#include "chrono"
 #include "condition_variable"
+#include "map"
 #include "mutex"
 #include "queue"
 #include "sparks/assets/assets.h"
+#include "sparks/renderer/bdpt.h"
+#include "sparks/renderer/checkpoint.h"
+#include "sparks/renderer/numa.h"
 #include "sparks/renderer/path_tracer.h"
+#include "sparks/renderer/ppm.h"
 #include "sparks/renderer/renderer_settings.h"
 #include "sparks/renderer/util.h"
 #include "sparks/util/util.h"
@@ -13,20 +20,40 @@ namespace sparks {
 class Renderer {
  public:
   explicit Renderer(const RendererSettings &renderer_settings);
+  // The scene to edit. Workers see the edits after ResetAccumulation
   Scene &GetScene();
   [[nodiscard]] const Scene &GetScene() const;
   RendererSettings &GetRendererSettings();
   [[nodiscard]] const RendererSettings &GetRendererSettings() const;
 
+  // Start worker threads. With numa_aware, one pinned worker group per node
   void StartWorkerThreads();
+  // Tiles in flight are cancelled between two samples, so this returns quickly
   void PauseWorkers();
   void ResumeWorkers();
   void StopWorkers();
 
   [[nodiscard]] RenderStateSignal GetRenderStateSignal() const;
   void Resize(uint32_t width, uint32_t height);
+  /* @brief Publish a snapshot of the edited scene and restart accumulating.
+  * Workers do not pause: each one switches to the new snapshot at its next
+  * tile, and results of tiles started before the reset are dropped.
+  */
   void ResetAccumulation();
 
+  /* @brief Generate the camera ray of one sample of a pixel.
+  * @param sampler, started at x, y and sample. The camera draws the first
+  * dimensions, the path continues with it
+  */
+  void GeneratePrimaryRay(int x,
+                          int y,
+                          int sample,
+                          const Scene &scene,
+                          glm::vec3 *origin,
+                          glm::vec3 *direction,
+                          float *time,
+                          Sampler *sampler) const;
+
   /* @brief Generate color of pixel sampled with one ray.
   * @param x,y pixel position
   * @param sample, the number of sample. Together with x,y, only used as seed
@@ -36,15 +63,39 @@ class Renderer {
                      int sample,
                      glm::vec3 &color_result,
                      PathTracer &path_tracer) const;
+  // The same with the bidirectional integrator
+  void RayGeneration(int x,
+                     int y,
+                     int sample,
+                     glm::vec3 &color_result,
+                     BdptIntegrator &bdpt) const;
+  // The same with photon mapping, whose photon map is set and built
+  void RayGeneration(int x,
+                     int y,
+                     int sample,
+                     glm::vec3 &color_result,
+                     PpmIntegrator &ppm) const;
 
+  /* @brief Copy the accumulation buffers without taking the worker lock.
+  * Rows being written are copied again, so each block of kSeqlockRows rows is
+  * consistent. Must not be called concurrently with Resize.
+  */
   void RetrieveAccumulationResult(glm::vec4 *accumulation_color_buffer_dst,
                                   float *accumulation_number_buffer_dst);
+  /* @brief Like RetrieveAccumulationResult, but only copy the regions that
+  * changed since the previous call. The rest of the destination buffers must
+  * still hold the previous result, so there should be a single consumer.
+  * @return the copied regions, at most one per kSeqlockRows rows
+  */
+  std::vector<ImageRegion> RetrieveAccumulationUpdate(
+      glm::vec4 *accumulation_color_buffer_dst,
+      float *accumulation_number_buffer_dst);
 
   [[nodiscard]] bool IsPaused() const;
   int LoadTexture(const std::string &file_path);
   int LoadObjMesh(const std::string &file_path);
 
-  // Load a customized scene (Other than the default one)
+  // Load a customized scene (Other than the default one) and publish it
   void LoadScene(const std::string &file_path);
 
   template <class ReturnType>
@@ -61,8 +112,26 @@ class Renderer {
   }
 
   int GetAccumulatedSamples();
+  // True once the time budget is exhausted and every pixel has the same spp
+  [[nodiscard]] bool IsBudgetExhausted();
+  /* @brief Wait until every pixel has accumulated sample_target samples, with
+  * no task in flight.
+  * @return false if the target is not reached within timeout
+  */
+  bool WaitForSampleTarget(std::chrono::milliseconds timeout);
   std::vector<glm::vec4> CaptureRenderedImage();
 
+  /* @brief Save the accumulation and the sample counter of every tile.
+  * Workers are paused only while the state is copied, not while writing.
+  * @return false on IO error
+  */
+  bool SaveCheckpoint(const std::string &path);
+  /* @brief Continue the accumulation stored in a checkpoint. The checkpoint
+  * must have the current resolution.
+  * @return false if the file can not be used, the accumulation is unchanged
+  */
+  bool LoadCheckpoint(const std::string &path);
+
   [[nodiscard]] uint32_t GetWidth() const {
     return width_;
   }
@@ -71,17 +140,173 @@ class Renderer {
   }
 
  private:
-  void WorkerThread();
+  /* Workers of a group share a task queue that only holds tiles of the rows
+  * owned by the group, so accumulation writes stay on the group's node.
+  */
+  struct WorkerGroup {
+    std::vector<int> cpus; // Empty: do not pin
+    uint32_t num_threads{0};
+    uint32_t y_begin{0}; // Rows [y_begin, y_end) of the image
+    uint32_t y_end{0};
+    // Statistics for numa_stats
+    uint64_t num_samples{0};
+    uint64_t num_local_tasks{0};
+    uint64_t num_remote_tasks{0}; // Tasks stolen from another group's rows
+  };
+
+  // A model of scene_ and its copy on the node of one worker group
+  struct ModelReplica {
+    std::shared_ptr<const Model> original; // Keeps the key of the map valid
+    std::shared_ptr<const Model> replica;
+  };
+
+  void WorkerThread(uint32_t group_index);
+  /* Copy scene_ for the workers of each group, with the BSDFs of its
+  * materials compiled. With several groups, each copy and its models are made
+  * on the group's node; models are cloned once and reused by later snapshots.
+  * Called by the thread that edits scene_
+  */
+  [[nodiscard]] std::vector<std::shared_ptr<const Scene>> CreateSnapshots_();
+  // Seed index of a sample of this process, see RendererSettings
+  [[nodiscard]] int GetGlobalSample_(uint32_t local_sample) const;
+  // Split image rows among worker groups, proportional to their threads
+  void AssignGroupRows_();
+  [[nodiscard]] uint32_t GetGroupOfRow_(uint32_t y) const;
+  // Zero the accumulation buffers, each band touched first by its own node
+  void FirstTouchAccumulation_();
+  /* Pick the queue a worker of group_index takes its next task from.
+  * Steal from the most lagging group only when the own queue is ahead.
+  * @return -1 if there is no task at all
+  */
+  [[nodiscard]] int SelectTaskQueue_(uint32_t group_index) const;
+  /* Stop issuing new passes if the next one would not finish before the
+  * time budget ends. Tasks of the pass in flight are still issued, so every
+  * pixel ends with the same number of samples. Called with task_queue_mutex_ held
+  */
+  void UpdateDeadline_();
+  // Report the achieved spp once the last task before the deadline finished
+  void CheckBudgetExhausted_();
+  // Called with task_queue_mutex_ held
+  [[nodiscard]] bool IsSampleTargetReached_() const;
+  // Samples to render for a task, fewer for the last pass before sample_target
+  [[nodiscard]] int GetTaskSamples_(const TaskInfo &task) const;
+  // Restart the time budget. Called with task_queue_mutex_ held
+  void RestartBudget_();
+  // Called with task_queue_mutex_ held
+  void ReportNumaStats_();
+  /* Photon map of the pass starting at a local sample, created unbuilt if no
+  * worker asked for it yet. Maps of passes no task needs any more are dropped.
+  * Called with task_queue_mutex_ held
+  */
+  [[nodiscard]] std::shared_ptr<PhotonMap> GetPhotonMap_(uint32_t sample);
+  // Called with task_queue_mutex_ held and no task in flight
+  void CaptureCheckpoint_(Checkpoint &checkpoint) const;
+  /* Seqlock around writes to accumulation rows [y_begin, y_end). Writers are
+  * serialized by task_queue_mutex_
+  */
+  void BeginWriteRows_(uint32_t y_begin, uint32_t y_end);
+  void EndWriteRows_(uint32_t y_begin, uint32_t y_end);
+  // Mark a written rectangle for RetrieveAccumulationUpdate, after EndWriteRows_
+  void MarkDirty_(uint32_t x_begin,
+                  uint32_t x_end,
+                  uint32_t y_begin,
+                  uint32_t y_end);
+  // Consistently copy columns [x_begin, x_end) of a block of rows
+  void CopyRowBlock_(uint32_t block,
+                     uint32_t x_begin,
+                     uint32_t x_end,
+                     glm::vec4 *accumulation_color_buffer_dst,
+                     float *accumulation_number_buffer_dst) const;
+  // True if a periodic checkpoint is due. Called with task_queue_mutex_ held
+  [[nodiscard]] bool IsCheckpointDue_() const;
+  // Fill task queues with square tiles of GetInitialTileSize_()
+  void BuildInitialTasks_();
+  /* Tile size from the settings, or if unset the largest power of two that
+  * still gives each thread kTasksPerThread tiles per pass
+  */
+  [[nodiscard]] uint32_t GetInitialTileSize_() const;
+  /* Order tiles by the tile_order setting. Along a space-filling curve,
+  * consecutive tiles are neighbours and share BVH nodes and texels in cache.
+  */
+  void OrderTiles_(std::vector<std::pair<float, TaskInfo>> &tiles) const;
+  /* Record the render time of a finished task of num_samples samples per
+  * pixel. Called with task_queue_mutex_ held
+  */
+  void RecordTaskCost_(const TaskInfo &task, int num_samples, float seconds);
+  /* Rebuild the tiles of a queue from the measured cost map. Blocks whose cost
+  * exceeds a share of the band are split, and cheap blocks are kept whole.
+  * Called with task_queue_mutex_ held, when
+  * every tile of the queue has reached the given sample.
+  */
+  void RebuildTasks_(uint32_t queue_index, uint32_t sample);
+  void SplitTile_(uint32_t x,
+                  uint32_t y,
+                  uint32_t size,
+                  uint32_t y_end,
+                  uint32_t sample,
+                  float target_cost,
+                  std::vector<std::pair<float, TaskInfo>> &tiles) const;
+  // Estimated cost of one sample over the block, in seconds
+  [[nodiscard]] float GetBlockCost_(uint32_t x,
+                                    uint32_t y,
+                                    uint32_t width,
+                                    uint32_t height) const;
 
   RendererSettings renderer_settings_;
-  Scene scene_{"../../scenes/custom.xml"}; // Default scene
+  Scene scene_{"../../scenes/custom.xml"}; // Default scene, edited by the app
+  // Read-only copies rendered by the workers, one per worker group. Models
+  // are shared with scene_ unless there are several groups, geometries and
+  // texture buffers always are. A snapshot is freed once the last worker
+  // moved on to a newer one
+  std::vector<std::shared_ptr<const Scene>> scene_snapshots_;
+  // Per worker group, by the model of scene_
+  std::vector<std::map<const Model *, ModelReplica>> model_replicas_;
+  uint32_t accumulation_epoch_{0}; // Incremented by ResetAccumulation
+  // Set while pausing. Workers check it between samples and abandon their tile
+  std::atomic<bool> cancel_tasks_{false};
+  // Cancelled tiles, rendered again once before taking new tasks
+  std::vector<TaskInfo> retry_tasks_;
+  // Photon maps of the passes in flight, by their first local sample
+  std::map<uint32_t, std::shared_ptr<PhotonMap>> photon_maps_;
 
   /* CPU Renderer Assets */
-  std::vector<glm::vec4> accumulation_color_;
-  std::vector<float> accumulation_number_;
-  std::queue<TaskInfo> task_queue_;
+  std::vector<glm::vec4, DefaultInitAllocator<glm::vec4>> accumulation_color_;
+  std::vector<float, DefaultInitAllocator<float>> accumulation_number_;
+  // Version of each block of rows, odd while the block is being written
+  static constexpr uint32_t kSeqlockRows = 16;
+  std::unique_ptr<std::atomic<uint32_t>[]> row_block_versions_;
+  // Changed columns of each block of rows, x_begin << 32 | x_end
+  static constexpr uint64_t kCleanColumns = 0xffffffffull << 32;
+  std::unique_ptr<std::atomic<uint64_t>[]> row_block_dirty_;
+  uint32_t num_row_blocks_{0};
+  std::vector<std::queue<TaskInfo>> task_queues_; // One per worker group
+  std::vector<WorkerGroup> worker_groups_;
+  std::chrono::steady_clock::time_point last_numa_report_;
+
+  // Cost map for adaptive tiles, one cell per kCostCellSize^2 pixels
+  static constexpr uint32_t kCostCellSize = 4;
+  static constexpr uint32_t kMaxTileSize = 64;
+  static constexpr uint32_t kTasksPerThread = 16; // Per pass, for balance
+  std::vector<float> cell_costs_; // Seconds per pixel sample, 0 if unmeasured
+  uint32_t num_cell_columns_{0};
+  uint32_t num_cell_rows_{0};
+  std::vector<uint32_t> next_rebuild_sample_; // Per queue
+
+  // Time budget state
+  std::chrono::steady_clock::time_point render_start_;
+  uint32_t max_issued_sample_{0}; // Largest sample count a tile will reach
+  uint32_t deadline_sample_{0}; // Target spp once deadline_reached_
+  bool deadline_reached_{false};
+  bool budget_exhausted_{false};
+  uint32_t num_working_thread_{0};
+
+  // Periodic checkpoints. While pending, no new task is issued so the last
+  // worker to finish sees a consistent state
+  std::chrono::steady_clock::time_point last_checkpoint_;
+  bool checkpoint_pending_{false};
 
   std::condition_variable wait_for_queue_cv_;
+  std::condition_variable wait_for_target_cv_;
   std::condition_variable wait_for_resume_cv_;
   std::condition_variable wait_for_all_pause_;
   std::condition_variable wait_for_all_exit_;
@@ -1,4 +1,9 @@
 #pragma once
+#include "cstdint"
+#include "sparks/assets/light.h"
+#include "sparks/renderer/util.h"
+#include "sparks/util/sampler.h"
+#include "string"
 
 namespace sparks {
 struct RendererSettings {
@@ -6,5 +11,24 @@ struct RendererSettings {
   int num_bounces{32};
   float prob_rr{ 0.9 }; // russian roulette probability
   float max_color{ 5.0 };
+  bool numa_aware{false}; // one worker group per NUMA node, image split into bands
+  bool numa_stats{false}; // periodically log per-node throughput and remote writes
+  float time_budget{0.0f}; // wall-clock seconds per accumulation, 0 for unlimited
+  uint32_t sample_target{0}; // local spp at which no more tasks are issued, 0 for unlimited
+  bool adaptive_tiles{true}; // resize and reorder tiles by their measured cost
+  int tile_size{0}; // initial tile size, rounded to a power of two in [4, 64]. 0 for auto
+  TileOrder tile_order{TILE_ORDER_HILBERT};
+  IntegratorType integrator{INTEGRATOR_PATH};
+  int photons_per_pass{1 << 18}; // photons traced each pass by INTEGRATOR_PPM
+  float photon_radius{0.05f}; // gather radius of the first pass, shrinks with each pass
+  bool wavefront{false}; // trace tiles breadth-first with WavefrontIntegrator, INTEGRATOR_PATH only
+  SamplerType sampler{SAMPLER_SOBOL};
+  bool blue_noise{false}; // one shared sequence per image, rotated by blue noise per pixel
+  LightSampling light_sampling{LIGHT_SAMPLING_TREE};
+  std::string checkpoint_path; // where checkpoints are written, empty for none
+  float checkpoint_interval{0.0f}; // seconds between checkpoints, 0 for none
+  // This process renders global samples local * count + index
+  uint32_t sample_partition_count{1};
+  uint32_t sample_partition_index{0};
 };
 }  // namespace sparks
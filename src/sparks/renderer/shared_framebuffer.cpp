@@ -0,0 +1,136 @@
+#include "sparks/renderer/shared_framebuffer.h"
+
+#include "cstring"
+#include "sparks/renderer/renderer.h"
+#include "sparks/util/util.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace sparks {
+
+namespace {
+constexpr char kSharedFramebufferMagic[4] = {'S', 'P', 'K', 'F'};
+constexpr uint32_t kSharedFramebufferVersion = 1;
+}  // namespace
+
+SharedFramebuffer::~SharedFramebuffer() {
+  Close();
+}
+
+bool SharedFramebuffer::Open(const std::string &name,
+                             uint32_t width,
+                             uint32_t height,
+                             bool unlink_on_close) {
+  Close();
+  size_t num_pixels = size_t(width) * height;
+  size_t size = sizeof(SharedFramebufferHeader) +
+                (sizeof(glm::vec4) + sizeof(float)) * num_pixels;
+#if defined(_WIN32)
+  handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                               DWORD(uint64_t(size) >> 32), DWORD(size),
+                               name.c_str());
+  if (!handle_) {
+    LAND_WARN("Shared framebuffer: cannot create mapping {}", name);
+    return false;
+  }
+  mapping_ = MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (!mapping_) {
+    LAND_WARN("Shared framebuffer: cannot map {}", name);
+    CloseHandle(handle_);
+    handle_ = nullptr;
+    return false;
+  }
+#else
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    LAND_WARN("Shared framebuffer: cannot open {}", name);
+    return false;
+  }
+  if (ftruncate(fd, off_t(size)) != 0) {
+    LAND_WARN("Shared framebuffer: cannot resize {}", name);
+    close(fd);
+    return false;
+  }
+  mapping_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping_ == MAP_FAILED) {
+    LAND_WARN("Shared framebuffer: cannot map {}", name);
+    mapping_ = nullptr;
+    return false;
+  }
+#endif
+  name_ = name;
+  unlink_on_close_ = unlink_on_close;
+  size_ = size;
+  header_ = new (mapping_) SharedFramebufferHeader{};
+  std::memcpy(header_->magic, kSharedFramebufferMagic, sizeof(header_->magic));
+  header_->version = kSharedFramebufferVersion;
+  header_->width = width;
+  header_->height = height;
+  header_->samples = 0;
+  header_->generation.store(1, std::memory_order_relaxed); // Not yet written
+  color_ = reinterpret_cast<glm::vec4 *>(header_ + 1);
+  number_ = reinterpret_cast<float *>(color_ + num_pixels);
+  LAND_INFO("Shared framebuffer: publishing {}x{} to {}", width, height, name);
+  return true;
+}
+
+void SharedFramebuffer::Close() {
+  if (!mapping_) {
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(mapping_);
+  CloseHandle(handle_);
+  handle_ = nullptr;
+#else
+  munmap(mapping_, size_);
+  if (unlink_on_close_) {
+    shm_unlink(name_.c_str());
+  }
+#endif
+  mapping_ = nullptr;
+  header_ = nullptr;
+  color_ = nullptr;
+  number_ = nullptr;
+}
+
+void SharedFramebuffer::Publish(Renderer *renderer) {
+  if (!header_ || renderer->GetWidth() != header_->width ||
+      renderer->GetHeight() != header_->height) {
+    return;
+  }
+  uint64_t generation = header_->generation.load(std::memory_order_relaxed);
+  if (!(generation & 1u)) {
+    header_->generation.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  // Read before copying, the copy has at least these samples
+  header_->samples = uint32_t(renderer->GetAccumulatedSamples());
+  // Only regions changed since the previous publish are copied
+  renderer->RetrieveAccumulationUpdate(color_, number_);
+  header_->generation.store((generation | 1u) + 1, std::memory_order_release);
+}
+
+void SharedFramebuffer::Publish(const glm::vec4 *color,
+                                const float *number,
+                                uint32_t samples) {
+  if (!header_) {
+    return;
+  }
+  uint64_t generation = header_->generation.load(std::memory_order_relaxed);
+  header_->generation.store(generation | 1u, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  size_t num_pixels = size_t(header_->width) * header_->height;
+  header_->samples = samples;
+  std::memcpy(color_, color, sizeof(glm::vec4) * num_pixels);
+  std::memcpy(number_, number, sizeof(float) * num_pixels);
+  header_->generation.store((generation | 1u) + 1, std::memory_order_release);
+}
+}  // namespace sparks
@@ -0,0 +1,61 @@
+#pragma once
+#include "atomic"
+#include "cstdint"
+#include "glm/glm.hpp"
+#include "string"
+
+namespace sparks {
+class Renderer;
+
+/* Layout of the shared framebuffer: this header, then width * height RGBA32F
+* accumulated colors, then width * height float sample counts. The radiance
+* of a pixel is color / max(count, 1). A reader copies while generation is
+* even and unchanged before and after the copy.
+*/
+struct SharedFramebufferHeader {
+  char magic[4]; // "SPKF"
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t samples; // Samples every pixel has at least
+  uint32_t reserved;
+  std::atomic<uint64_t> generation; // Odd while being written
+};
+
+/* @brief The accumulation of a renderer, published to a POSIX shared memory
+* object (a named file mapping on Windows) so external viewers can watch it
+* without any IPC. On POSIX the object outlives the renderer unless
+* unlink_on_close is set, so the final image stays readable; its consumer
+* removes it with shm_unlink. A Windows mapping lives while a handle is open.
+*/
+class SharedFramebuffer {
+ public:
+  SharedFramebuffer() = default;
+  ~SharedFramebuffer();
+  SharedFramebuffer(const SharedFramebuffer &) = delete;
+  SharedFramebuffer &operator=(const SharedFramebuffer &) = delete;
+
+  // Create or resize the shared memory object name. Return false on error
+  bool Open(const std::string &name,
+            uint32_t width,
+            uint32_t height,
+            bool unlink_on_close = false);
+  void Close();
+  // Copy the regions changed since the last publish and bump the generation
+  void Publish(Renderer *renderer);
+  // Copy whole buffers, e.g. the merge of distributed workers
+  void Publish(const glm::vec4 *color, const float *number, uint32_t samples);
+
+ private:
+  std::string name_;
+  bool unlink_on_close_{false};
+  void *mapping_{nullptr};
+  size_t size_{0};
+#if defined(_WIN32)
+  void *handle_{nullptr};
+#endif
+  SharedFramebufferHeader *header_{nullptr};
+  glm::vec4 *color_{nullptr};
+  float *number_{nullptr};
+};
+}  // namespace sparks
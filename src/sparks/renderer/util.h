@@ -9,6 +9,19 @@ typedef enum RenderStateSignal : uint32_t {
   RENDER_STATE_SIGNAL_EXIT = 2
 } RenderStateSignal;
 
+typedef enum TileOrder : uint32_t {
+  TILE_ORDER_RANDOM = 0,
+  TILE_ORDER_MORTON = 1,
+  TILE_ORDER_HILBERT = 2,
+  TILE_ORDER_COST = 3 // Most expensive first, Hilbert order among equals
+} TileOrder;
+
+typedef enum IntegratorType : uint32_t {
+  INTEGRATOR_PATH = 0,
+  INTEGRATOR_BDPT = 1, // Bidirectional, for light reached through gaps and glass
+  INTEGRATOR_PPM = 2   // Progressive photon mapping, for caustics
+} IntegratorType;
+
 struct TaskInfo {
   uint32_t x;
   uint32_t y;
@@ -16,4 +29,20 @@ struct TaskInfo {
   uint32_t height;
   uint32_t sample; // Number of samples on this pixel
 };
+
+// A rectangle of pixels of the image
+struct ImageRegion {
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Position of (x, y) along the Z-order curve
+uint64_t MortonIndex(uint32_t x, uint32_t y);
+
+/* @brief Position of (x, y) along the Hilbert curve covering an n x n grid.
+* @param n grid size, a power of two
+*/
+uint64_t HilbertIndex(uint32_t n, uint32_t x, uint32_t y);
 }  // namespace sparks
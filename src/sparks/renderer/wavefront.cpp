@@ -0,0 +1,195 @@
+#include "sparks/renderer/wavefront.h"
+
+#include "algorithm"
+#include "array"
+#include "sparks/renderer/renderer.h"
+#include "sparks/util/util.h"
+
+namespace sparks {
+WavefrontIntegrator::WavefrontIntegrator(const RendererSettings *render_settings)
+    : render_settings_(render_settings),
+      path_tracer_(render_settings, nullptr) {
+}
+
+void WavefrontIntegrator::SetScene(const Scene *scene) {
+  scene_ = scene;
+  path_tracer_.SetScene(scene);
+}
+
+bool WavefrontIntegrator::RenderTile(const Renderer &renderer,
+                                     const TaskInfo &task,
+                                     const std::vector<int> &samples,
+                                     const std::atomic<bool> &cancel,
+                                     std::vector<glm::vec3> &sample_result) {
+  uint32_t num_paths = task.width * task.height * uint32_t(samples.size());
+  sample_result.assign(task.width * task.height, glm::vec3{0.0f});
+  for (uint32_t first_path = 0; first_path < num_paths;
+       first_path += kBatchSize) {
+    GeneratePaths_(renderer, task, samples, first_path,
+                   std::min(kBatchSize, num_paths - first_path));
+    while (!ray_queue_.empty()) {
+      if (cancel.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      SortRays_();
+      Intersect_();
+      SortByMaterial_();
+      Shade_();
+      TraceShadowRays_();
+      Advance_();
+    }
+    // Paths are in pixel-major order, so samples add up in the same order
+    for (uint32_t i = 0; i < pixel_.size(); i++) {
+      glm::vec3 color = radiance_[i];
+      color.x = clamp(color.x, 0.0f, render_settings_->max_color);
+      color.y = clamp(color.y, 0.0f, render_settings_->max_color);
+      color.z = clamp(color.z, 0.0f, render_settings_->max_color);
+      sample_result[pixel_[i]] += color;
+    }
+  }
+  return true;
+}
+
+void WavefrontIntegrator::GeneratePaths_(const Renderer &renderer,
+                                         const TaskInfo &task,
+                                         const std::vector<int> &samples,
+                                         uint32_t first_path,
+                                         uint32_t num_paths) {
+  pixel_.resize(num_paths);
+  origin_.resize(num_paths);
+  direction_.resize(num_paths);
+  time_.resize(num_paths);
+  throughput_.assign(num_paths, glm::vec3{1.0f});
+  radiance_.assign(num_paths, glm::vec3{0.0f});
+  bounce_.assign(num_paths, 0);
+  sampler_.resize(num_paths, Sampler(render_settings_->sampler,
+                                     render_settings_->blue_noise));
+  hit_record_.resize(num_paths);
+  scatter_.assign(num_paths, PathTracer::GetCameraScatter());
+  ray_queue_.clear();
+  for (uint32_t i = 0; i < num_paths; i++) {
+    uint32_t path = first_path + i;
+    uint32_t id = path / uint32_t(samples.size());
+    int sample = samples[path % samples.size()];
+    pixel_[i] = id;
+    renderer.GeneratePrimaryRay(int(task.x + id % task.width),
+                                int(task.y + id / task.width), sample, *scene_,
+                                &origin_[i], &direction_[i], &time_[i],
+                                &sampler_[i]);
+    ray_queue_.push_back(i);
+  }
+}
+
+namespace {
+// Spread the low 10 bits of v to every third bit
+uint32_t SpreadBits(uint32_t v) {
+  v &= 0x3ffu;
+  v = (v | (v << 16)) & 0x30000ffu;
+  v = (v | (v << 8)) & 0x300f00fu;
+  v = (v | (v << 4)) & 0x30c30c3u;
+  v = (v | (v << 2)) & 0x9249249u;
+  return v;
+}
+}  // namespace
+
+void WavefrontIntegrator::SortRays_() {
+  // Primary rays are generated in pixel order, already coherent. Paths of a
+  // batch advance together, so the queue holds one bounce only
+  if (ray_queue_.empty() || bounce_[ray_queue_.front()] == 0) {
+    return;
+  }
+  glm::vec3 low{origin_[ray_queue_.front()]};
+  glm::vec3 high{low};
+  for (uint32_t i : ray_queue_) {
+    low = glm::min(low, origin_[i]);
+    high = glm::max(high, origin_[i]);
+  }
+  glm::vec3 scale = 1023.0f / glm::max(high - low, glm::vec3{1e-6f});
+  ray_keys_.clear();
+  for (uint32_t i : ray_queue_) {
+    glm::vec3 cell = (origin_[i] - low) * scale;
+    uint64_t octant = (direction_[i].x < 0.0f ? 1u : 0u) |
+                      (direction_[i].y < 0.0f ? 2u : 0u) |
+                      (direction_[i].z < 0.0f ? 4u : 0u);
+    uint64_t morton = SpreadBits(uint32_t(cell.x)) |
+                      (SpreadBits(uint32_t(cell.y)) << 1) |
+                      (SpreadBits(uint32_t(cell.z)) << 2);
+    ray_keys_.emplace_back(octant << 30 | morton, i);
+  }
+  // Paths are independent and summed by pixel_, the order does not change
+  // the result
+  std::sort(ray_keys_.begin(), ray_keys_.end());
+  for (size_t k = 0; k < ray_keys_.size(); k++) {
+    ray_queue_[k] = ray_keys_[k].second;
+  }
+}
+
+void WavefrontIntegrator::Intersect_() {
+  hit_queue_.clear();
+  for (uint32_t i : ray_queue_) {
+    float t = scene_->TraceRay(origin_[i], direction_[i], time_[i], 1e-3f,
+                               1e4f, &hit_record_[i]);
+    // scatter_[i] still holds the vertex the ray left
+    if (scatter_[i].count_emission) {
+      radiance_[i] += throughput_[i] * path_tracer_.ResolveEmission(
+                                           scatter_[i], direction_[i], t,
+                                           hit_record_[i]);
+    }
+    if (t > 0.0f && !scatter_[i].next_emission_only) {
+      throughput_[i] *= scatter_[i].next_rr_scale;
+      hit_queue_.push_back(i);
+    }
+  }
+}
+
+void WavefrontIntegrator::SortByMaterial_() {
+  // Counting sort, stable so paths of a kernel keep their order
+  std::array<uint32_t, kNumShadingKernels + 1> offsets{};
+  for (uint32_t i : hit_queue_) {
+    offsets[scene_->GetEntity(hit_record_[i].hit_entity_id).GetShadingKernel() + 1]++;
+  }
+  for (int kernel = 0; kernel < kNumShadingKernels; kernel++) {
+    offsets[kernel + 1] += offsets[kernel];
+  }
+  shade_queue_.resize(hit_queue_.size());
+  for (uint32_t i : hit_queue_) {
+    shade_queue_[offsets[scene_->GetEntity(hit_record_[i].hit_entity_id).GetShadingKernel()]++] = i;
+  }
+}
+
+void WavefrontIntegrator::Shade_() {
+  for (uint32_t i : shade_queue_) {
+    path_tracer_.Scatter(hit_record_[i], -direction_[i], bounce_[i],
+                         throughput_[i], sampler_[i], &scatter_[i]);
+  }
+}
+
+void WavefrontIntegrator::TraceShadowRays_() {
+  HitRecord hit_record;
+  for (uint32_t i : shade_queue_) {
+    auto &scatter = scatter_[i];
+    glm::vec3 p = hit_record_[i].position;
+    if (scatter.has_light_ray) {
+      float t = scene_->TraceRay(p, scatter.light_direction, time_[i], 1e-3f,
+                                 1e4f, &hit_record);
+      radiance_[i] += throughput_[i] *
+                      path_tracer_.ResolveLightRay(scatter, t, hit_record);
+    }
+  }
+}
+
+void WavefrontIntegrator::Advance_() {
+  ray_queue_.clear();
+  for (uint32_t i : shade_queue_) {
+    auto &scatter = scatter_[i];
+    if (!scatter.has_next_ray) {
+      continue;
+    }
+    throughput_[i] *= scatter.next_weight;
+    origin_[i] = hit_record_[i].position;
+    direction_[i] = scatter.next_direction;
+    bounce_[i]++;
+    ray_queue_.push_back(i);
+  }
+}
+}  // namespace sparks
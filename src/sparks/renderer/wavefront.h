@@ -0,0 +1,81 @@
+#pragma once
+#include "atomic"
+#include "cstdint"
+#include "sparks/util/sampler.h"
+#include "sparks/renderer/path_tracer.h"
+#include "sparks/renderer/renderer_settings.h"
+#include "sparks/renderer/util.h"
+#include "vector"
+
+namespace sparks {
+class Renderer;
+
+/* @brief Breadth-first path tracer. The paths of a tile are kept in SoA
+* buffers and advanced one stage at a time over the whole batch: generate,
+* sort rays, intersect, sort by material, shade and trace shadow rays. Rays
+* are still traced one at a time through the BVH, sorting them by direction
+* and origin only makes neighbouring traversals coherent. Each path runs the
+* same steps in the same order as PathTracer::SampleRayPathTrace, so both
+* integrators produce the same samples.
+*/
+class WavefrontIntegrator {
+ public:
+  explicit WavefrontIntegrator(const RendererSettings *render_settings);
+
+  void SetScene(const Scene *scene);
+
+  /* @brief Render some samples of every pixel of a tile.
+  * @param samples, global sample numbers rendered on each pixel
+  * @param sample_result, receives the sum of the samples of each pixel
+  * @return false if cancel was set before the tile finished
+  */
+  bool RenderTile(const Renderer &renderer,
+                  const TaskInfo &task,
+                  const std::vector<int> &samples,
+                  const std::atomic<bool> &cancel,
+                  std::vector<glm::vec3> &sample_result);
+
+ private:
+  // Paths live in batches of this size, bounding the memory of the buffers
+  static constexpr uint32_t kBatchSize = 4096;
+
+  const RendererSettings *render_settings_{};
+  const Scene *scene_{};
+  PathTracer path_tracer_;
+
+  // Path states, indexed by path
+  std::vector<uint32_t> pixel_;
+  std::vector<glm::vec3> origin_;
+  std::vector<glm::vec3> direction_;
+  std::vector<float> time_;
+  std::vector<glm::vec3> throughput_;
+  std::vector<glm::vec3> radiance_;
+  std::vector<int> bounce_;
+  std::vector<Sampler> sampler_;
+  std::vector<HitRecord> hit_record_;
+  std::vector<PathScatter> scatter_;
+
+  // Stage queues, holding path indices
+  std::vector<uint32_t> ray_queue_;
+  std::vector<uint32_t> hit_queue_;
+  std::vector<uint32_t> shade_queue_;
+  // Sort key and path index of each queued ray
+  std::vector<std::pair<uint64_t, uint32_t>> ray_keys_;
+
+  void GeneratePaths_(const Renderer &renderer,
+                      const TaskInfo &task,
+                      const std::vector<int> &samples,
+                      uint32_t first_path,
+                      uint32_t num_paths);
+  // Group the secondary rays by direction octant, then by the Morton code of
+  // their origin, so consecutive rays visit the same BVH nodes
+  void SortRays_();
+  void Intersect_();
+  // Group the hits by shading kernel, so shading runs one kernel at a time
+  void SortByMaterial_();
+  void Shade_();
+  void TraceShadowRays_();
+  // Queue the paths that continue for the next intersect stage
+  void Advance_();
+};
+}  // namespace sparks
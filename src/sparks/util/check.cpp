@@ -0,0 +1,33 @@
+#include "sparks/util/check.h"
+
+#include "grassland/grassland.h"
+#include "mutex"
+#include "vector"
+
+namespace sparks {
+namespace {
+std::mutex &GetSitesMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::vector<const CheckSite *> &GetSites() {
+  static std::vector<const CheckSite *> sites;
+  return sites;
+}
+}  // namespace
+
+CheckSite::CheckSite(const char *message, const char *file, int line)
+    : message_(message), file_(file), line_(line) {
+  std::lock_guard<std::mutex> lock(GetSitesMutex());
+  GetSites().push_back(this);
+}
+
+void ReportCheckFailures() {
+  std::lock_guard<std::mutex> lock(GetSitesMutex());
+  for (auto site : GetSites()) {
+    LAND_WARN("Check \"{}\" failed {} times ({}:{})", site->GetMessage(),
+              site->GetFailures(), site->GetFile(), site->GetLine());
+  }
+}
+}  // namespace sparks
@@ -0,0 +1,83 @@
+#pragma once
+#include "atomic"
+#include "cstdint"
+#include "glm/glm.hpp"
+
+/* SPARKS_CHECK_LEVEL picks the validation compiled into the hot path:
+* 0 removes every check, 1 keeps the cheap ones and 2 adds those that cost a
+* length or a matrix per call. Release builds default to 0, others to 2;
+* define it to 1 to keep only the cheap checks in a debug build.
+* A failing check is counted at its site, not logged, and the counts are
+* reported together by ReportCheckFailures.
+*/
+#ifndef SPARKS_CHECK_LEVEL
+#ifdef NDEBUG
+#define SPARKS_CHECK_LEVEL 0
+#else
+#define SPARKS_CHECK_LEVEL 2
+#endif
+#endif
+
+namespace sparks {
+// One check in the source, created on its first failure
+class CheckSite {
+ public:
+  CheckSite(const char *message, const char *file, int line);
+  void Fail() {
+    failures_.fetch_add(1, std::memory_order_relaxed);
+  }
+  [[nodiscard]] uint64_t GetFailures() const {
+    return failures_.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] const char *GetMessage() const {
+    return message_;
+  }
+  [[nodiscard]] const char *GetFile() const {
+    return file_;
+  }
+  [[nodiscard]] int GetLine() const {
+    return line_;
+  }
+
+ private:
+  const char *message_;
+  const char *file_;
+  int line_;
+  std::atomic<uint64_t> failures_{0};
+};
+
+// Log the failure count of every check that failed so far
+void ReportCheckFailures();
+}  // namespace sparks
+
+#define SPARKS_CHECK_COUNT_(condition, message)                           \
+  do {                                                                    \
+    if (!(condition)) {                                                   \
+      static ::sparks::CheckSite sparks_check_site(message, __FILE__,     \
+                                                   __LINE__);             \
+      sparks_check_site.Fail();                                           \
+    }                                                                     \
+  } while (false)
+// Compiled out, but the condition still has to compile
+#define SPARKS_CHECK_NONE_(condition, message) \
+  do {                                         \
+    (void)sizeof(!(condition));                \
+  } while (false)
+
+#if SPARKS_CHECK_LEVEL >= 1
+#define SPARKS_CHECK(condition, message) SPARKS_CHECK_COUNT_(condition, message)
+#else
+#define SPARKS_CHECK(condition, message) SPARKS_CHECK_NONE_(condition, message)
+#endif
+
+#if SPARKS_CHECK_LEVEL >= 2
+#define SPARKS_CHECK_EXPENSIVE(condition, message) \
+  SPARKS_CHECK_COUNT_(condition, message)
+#else
+#define SPARKS_CHECK_EXPENSIVE(condition, message) \
+  SPARKS_CHECK_NONE_(condition, message)
+#endif
+
+// |v| is 1 up to eps
+#define SPARKS_CHECK_NORMALIZED(v, eps, message) \
+  SPARKS_CHECK_EXPENSIVE(glm::abs(glm::length(v) - 1.0f) <= (eps), message)
@@ -30,12 +30,10 @@ float MicrofacetDistribution::Lambda(const glm::vec3& w) const
   float alpha2Tan2Theta = (alpha * absTanTheta) * (alpha * absTanTheta);
   return (-1 + std::sqrt(1.0f + alpha2Tan2Theta)) / 2;
 }
-glm::vec3 MicrofacetDistribution::SampleWh(const glm::vec3& wo, std::mt19937& rng) const
+glm::vec3 MicrofacetDistribution::SampleWh(const glm::vec3& wo, Sampler& sampler) const
 {
   glm::vec3 tangent_wo = GetWorld2Tangent_() * wo;
-  if (tangent_wo.z == 0.0f) {
-    LAND_ERROR("Zero tangent wo! wo {}, normal {}", glm::to_string(wo), glm::to_string(normal_));
-  }
+  SPARKS_CHECK(tangent_wo.z != 0.0f, "Zero tangent wo");
   bool flip = tangent_wo.z < 0;
   if (flip) {
     tangent_wo = -tangent_wo;
@@ -46,8 +44,9 @@ glm::vec3 MicrofacetDistribution::SampleWh(const glm::vec3& wo, std::mt19937& rn
     glm::normalize(glm::vec3(alpha_x_ * tangent_wo.x, alpha_y_ * tangent_wo.y, tangent_wo.z));
 
   // 2. simulate P22_{tangent_wo}(x_slope, y_slope, 1, 1)
-  float u1 = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
-  float u2 = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+  glm::vec2 u = sampler.Get2D();
+  float u1 = u.x;
+  float u2 = u.y;
   float slope_x, slope_y;
   TrowbridgeReitzSample11_(CosTheta(tangent_wo_stretched), u1, u2, &slope_x, &slope_y);
 
@@ -67,10 +66,8 @@ glm::vec3 MicrofacetDistribution::SampleWh(const glm::vec3& wo, std::mt19937& rn
   }
   
   auto result = GetTangent2World_() * tangent_wh;
-  if (glm::abs(glm::length(result) - 1.0f) > 1e-5f) {
-    LAND_ERROR("Unnormalized result! {}, tangent_wh {}, tangent2world_ {}", glm::length(result), glm::to_string(tangent_wh), glm::to_string(GetTangent2World_()));
-  }
-  return GetTangent2World_() * tangent_wh;
+  SPARKS_CHECK_NORMALIZED(result, 1e-5f, "Unnormalized sampled half vector");
+  return result;
 }
 float MicrofacetDistribution::Pdf(const glm::vec3& wo, const glm::vec3& wh) const
 {
@@ -87,9 +84,7 @@ void MicrofacetDistribution::TrowbridgeReitzSample11_(float cosTheta, float u1,
     return;
   }
 
-  if (cosTheta == 0.0f) {
-    LAND_WARN("zero cosTheta!");
-  }
+  SPARKS_CHECK(cosTheta != 0.0f, "Zero cosTheta");
 
   float sinTheta =
     glm::sqrt(glm::max((float)0, (float)1 - cosTheta * cosTheta));
@@ -136,15 +131,9 @@ glm::mat3 MicrofacetDistribution::GetTangent2World_() const
     -normal_.x * normal_.x - normal_.y * normal_.y };
   l = glm::normalize(l);
   m = glm::normalize(m);
-  if (glm::abs(glm::length(l) - 1.0f) > 1e-5f) {
-    LAND_ERROR("Unnormalized l! {}", glm::to_string(l));
-  }
-  if (glm::abs(glm::length(m) - 1.0f) > 1e-5f) {
-    LAND_ERROR("Unnormalized m! {}", glm::to_string(m));
-  }
-  if (glm::abs(glm::length(normal_) - 1.0f) > 1e-5f) {
-    LAND_ERROR("Unnormalized normal! {}", glm::to_string(normal_));
-  }
+  SPARKS_CHECK_NORMALIZED(l, 1e-5f, "Unnormalized tangent l");
+  SPARKS_CHECK_NORMALIZED(m, 1e-5f, "Unnormalized tangent m");
+  SPARKS_CHECK_NORMALIZED(normal_, 1e-5f, "Unnormalized normal");
   return glm::mat3{ m,l,normal_ };
 }
 
@@ -1,9 +1,11 @@
 // https://github.com/mmp/pbrt-v3/
 #pragma once 
+#include "sparks/util/check.h"
 #include "sparks/util/util.h"
 #include "glm/glm.hpp"
 #include "glm/gtx/string_cast.hpp"
 #include <random>
+#include "sparks/util/sampler.h"
 
 namespace sparks {
 /* TrowbridgeReitzDistribution
@@ -13,9 +15,7 @@ class MicrofacetDistribution {
 public:
   MicrofacetDistribution(float alpha_x, float alpha_y, const glm::vec3& normal)
     : alpha_x_(alpha_x), alpha_y_(alpha_y), normal_(normal) {
-    if (glm::abs(glm::length(normal_) - 1.0f) > 1e-5f) {
-      LAND_ERROR("Unnormalized normal! {}", glm::to_string(normal_));
-    }
+    SPARKS_CHECK_NORMALIZED(normal_, 1e-5f, "Unnormalized normal");
   }
   float D(const glm::vec3& wh) const;
   float Lambda(const glm::vec3& w) const;
@@ -26,7 +26,7 @@ public:
   float G(const glm::vec3& wo, const glm::vec3& wi) const {
     return 1 / (1 + Lambda(wo) + Lambda(wi));
   }
-  glm::vec3 SampleWh(const glm::vec3& wo, std::mt19937& rng) const;
+  glm::vec3 SampleWh(const glm::vec3& wo, Sampler& sampler) const;
   float Pdf(const glm::vec3& wo, const glm::vec3& wh) const;
 
   float RoughnessToAlpha(float roughness) const {
@@ -0,0 +1,152 @@
+#include "sparks/util/log.h"
+
+#include "chrono"
+#include "condition_variable"
+#include "deque"
+#include "grassland/grassland.h"
+#include "mutex"
+#include "thread"
+#include "vector"
+
+namespace sparks {
+namespace {
+// Messages waiting beyond this are dropped rather than stalling the renderer
+constexpr size_t kMaxQueued = 1024;
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Write(LogLevel level, const std::string &message) {
+  switch (level) {
+    case LOG_LEVEL_INFO:
+      LAND_INFO("{}", message);
+      break;
+    case LOG_LEVEL_WARN:
+      LAND_WARN("{}", message);
+      break;
+    case LOG_LEVEL_ERROR:
+      LAND_ERROR("{}", message);
+      break;
+  }
+}
+
+class LogThread {
+ public:
+  LogThread() : thread_([this]() { Run_(); }) {
+  }
+  ~LogThread() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+
+  // False if the message was dropped
+  bool Push(LogLevel level, std::function<std::string()> message) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (queue_.size() >= kMaxQueued) {
+        return false;
+      }
+      queue_.emplace_back(level, std::move(message));
+    }
+    wake_.notify_one();
+    return true;
+  }
+
+  void Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return queue_.empty() && !writing_; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  std::deque<std::pair<LogLevel, std::function<std::string()>>> queue_;
+  bool writing_{false};
+  bool stop_{false};
+  std::thread thread_;
+
+  void Run_() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) { // Stopped, with everything written
+        return;
+      }
+      auto entry = std::move(queue_.front());
+      queue_.pop_front();
+      writing_ = true;
+      lock.unlock();
+      Write(entry.first, entry.second());
+      lock.lock();
+      writing_ = false;
+      if (queue_.empty()) {
+        idle_.notify_all();
+      }
+    }
+  }
+};
+
+LogThread &GetLogThread() {
+  static LogThread log_thread;
+  return log_thread;
+}
+
+std::mutex &GetSitesMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::vector<const LogSite *> &GetSites() {
+  static std::vector<const LogSite *> sites;
+  return sites;
+}
+}  // namespace
+
+LogSite::LogSite(LogLevel level, const char *format, const char *file, int line)
+    : level_(level), format_(format), file_(file), line_(line) {
+  std::lock_guard<std::mutex> lock(GetSitesMutex());
+  GetSites().push_back(this);
+}
+
+bool LogSite::Hit() {
+  uint64_t hits = hits_.fetch_add(1, std::memory_order_relaxed) + 1;
+  bool write = hits <= kBurst;
+  if (!write) {
+    int64_t now = NowNs();
+    int64_t next = next_write_ns_.load(std::memory_order_relaxed);
+    write = now >= next && next_write_ns_.compare_exchange_strong(
+                               next, now + 1000000000, std::memory_order_relaxed);
+  }
+  return write;
+}
+
+void LogSite::CountQueued(bool accepted) {
+  (accepted ? written_ : dropped_).fetch_add(1, std::memory_order_relaxed);
+}
+
+void EnqueueLog(LogSite &site, std::function<std::string()> message) {
+  site.CountQueued(GetLogThread().Push(site.GetLevel(), std::move(message)));
+}
+
+void FlushLogs() {
+  GetLogThread().Flush();
+}
+
+void ReportLogCounts() {
+  FlushLogs();
+  std::lock_guard<std::mutex> lock(GetSitesMutex());
+  for (auto site : GetSites()) {
+    LAND_INFO("Log \"{}\" hit {} times, {} written, {} dropped ({}:{})",
+              site->GetFormat(), site->GetHits(), site->GetWritten(),
+              site->GetDropped(), site->GetFile(), site->GetLine());
+  }
+}
+}  // namespace sparks
@@ -0,0 +1,84 @@
+#pragma once
+#include "atomic"
+#include "cstdint"
+#include "functional"
+#include "sparks/util/util.h"
+#include "string"
+
+namespace sparks {
+enum LogLevel { LOG_LEVEL_INFO, LOG_LEVEL_WARN, LOG_LEVEL_ERROR };
+
+/* @brief One log statement in the source, with its counters. The first
+* kBurst hits are written, then at most one per second.
+*/
+class LogSite {
+ public:
+  static constexpr uint64_t kBurst = 4;
+
+  LogSite(LogLevel level, const char *format, const char *file, int line);
+  // Count a hit, true if the message should be written
+  bool Hit();
+  // Count a message the logging thread accepted, or one it dropped
+  void CountQueued(bool accepted);
+  [[nodiscard]] LogLevel GetLevel() const {
+    return level_;
+  }
+  [[nodiscard]] const char *GetFormat() const {
+    return format_;
+  }
+  [[nodiscard]] const char *GetFile() const {
+    return file_;
+  }
+  [[nodiscard]] int GetLine() const {
+    return line_;
+  }
+  [[nodiscard]] uint64_t GetHits() const {
+    return hits_.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] uint64_t GetWritten() const {
+    return written_.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] uint64_t GetDropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  LogLevel level_;
+  const char *format_;
+  const char *file_;
+  int line_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> written_{0};
+  std::atomic<uint64_t> dropped_{0}; // Rate allowed, but the queue was full
+  std::atomic<int64_t> next_write_ns_{0};
+};
+
+/* @brief Hand a message of site to the logging thread, which formats and
+* writes it. Dropped if the thread is too far behind.
+*/
+void EnqueueLog(LogSite &site, std::function<std::string()> message);
+// Wait until the logging thread wrote every queued message
+void FlushLogs();
+// Flush, then log the counters of every site hit so far
+void ReportLogCounts();
+}  // namespace sparks
+
+/* Logging for the render hot path. The arguments are copied and formatted on
+* the logging thread, so pointers among them must outlive the render.
+*/
+#define SPARKS_LOG_(level, format_string, ...)                            \
+  do {                                                                    \
+    static ::sparks::LogSite sparks_log_site(level, format_string,        \
+                                             __FILE__, __LINE__);         \
+    if (sparks_log_site.Hit()) {                                          \
+      ::sparks::EnqueueLog(sparks_log_site, [=]() {                       \
+        return fmt::format(format_string, ##__VA_ARGS__);                 \
+      });                                                                 \
+    }                                                                     \
+  } while (false)
+#define SPARKS_LOG_INFO(format_string, ...) \
+  SPARKS_LOG_(::sparks::LOG_LEVEL_INFO, format_string, ##__VA_ARGS__)
+#define SPARKS_LOG_WARN(format_string, ...) \
+  SPARKS_LOG_(::sparks::LOG_LEVEL_WARN, format_string, ##__VA_ARGS__)
+#define SPARKS_LOG_ERROR(format_string, ...) \
+  SPARKS_LOG_(::sparks::LOG_LEVEL_ERROR, format_string, ##__VA_ARGS__)
@@ -0,0 +1,67 @@
+#include "sparks/util/piecewise_constant.h"
+
+#include "algorithm"
+#include "cmath"
+
+namespace sparks {
+// Based on https://github.com/mmp/pbrt-v3/
+PiecewiseConstant1D::PiecewiseConstant1D(const float *func, int n)
+    : func_(func, func + n), cdf_(n + 1) {
+  cdf_[0] = 0.0f;
+  for (int i = 1; i <= n; i++) {
+    cdf_[i] = cdf_[i - 1] + std::abs(func_[i - 1]) / float(n);
+  }
+  integral_ = cdf_[n];
+  for (int i = 1; i <= n; i++) {
+    // A zero function gets a uniform density
+    cdf_[i] = integral_ == 0.0f ? float(i) / float(n) : cdf_[i] / integral_;
+  }
+}
+
+float PiecewiseConstant1D::Sample(float u, float *pdf, int *offset) const {
+  int n = GetCount();
+  int o = int(std::upper_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin()) - 1;
+  o = std::clamp(o, 0, n - 1);
+  if (offset) {
+    *offset = o;
+  }
+  float du = u - cdf_[o];
+  if (cdf_[o + 1] - cdf_[o] > 0.0f) {
+    du /= cdf_[o + 1] - cdf_[o];
+  }
+  *pdf = integral_ > 0.0f ? std::abs(func_[o]) / integral_ : 0.0f;
+  return std::min((float(o) + du) / float(n), 0x1.fffffep-1f);
+}
+
+PiecewiseConstant2D::PiecewiseConstant2D(const float *func, int nu, int nv) {
+  conditional_.reserve(nv);
+  for (int v = 0; v < nv; v++) {
+    conditional_.emplace_back(func + v * nu, nu);
+  }
+  std::vector<float> marginal_func(nv);
+  for (int v = 0; v < nv; v++) {
+    marginal_func[v] = conditional_[v].GetIntegral();
+  }
+  marginal_ = PiecewiseConstant1D(marginal_func.data(), nv);
+}
+
+glm::vec2 PiecewiseConstant2D::Sample(glm::vec2 u, float *pdf) const {
+  float pdf_marginal, pdf_conditional;
+  int v;
+  float y = marginal_.Sample(u.y, &pdf_marginal, &v);
+  float x = conditional_[v].Sample(u.x, &pdf_conditional);
+  *pdf = pdf_marginal * pdf_conditional;
+  return {x, y};
+}
+
+float PiecewiseConstant2D::GetPdf(glm::vec2 p) const {
+  if (marginal_.GetIntegral() == 0.0f) {
+    return 0.0f;
+  }
+  const auto &conditional = conditional_[std::clamp(
+      int(p.y * float(marginal_.GetCount())), 0, marginal_.GetCount() - 1)];
+  int u = std::clamp(int(p.x * float(conditional.GetCount())), 0,
+                     conditional.GetCount() - 1);
+  return conditional.GetFunc(u) / marginal_.GetIntegral();
+}
+}  // namespace sparks
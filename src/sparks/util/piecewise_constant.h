@@ -0,0 +1,53 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "vector"
+
+namespace sparks {
+/* @brief Density proportional to a step function over [0, 1), sampled by
+* inverting its CDF.
+*/
+class PiecewiseConstant1D {
+ public:
+  PiecewiseConstant1D() = default;
+  PiecewiseConstant1D(const float *func, int n);
+
+  /* @param u, uniform in [0, 1)
+  * @return x in [0, 1), *pdf density at x, *offset the step holding x
+  */
+  float Sample(float u, float *pdf, int *offset = nullptr) const;
+  [[nodiscard]] int GetCount() const {
+    return int(func_.size());
+  }
+  [[nodiscard]] float GetFunc(int i) const {
+    return func_[i];
+  }
+  [[nodiscard]] float GetIntegral() const {
+    return integral_;
+  }
+
+ private:
+  std::vector<float> func_;
+  std::vector<float> cdf_; // GetCount() + 1 entries, from 0 to 1
+  float integral_{0.0f};
+};
+
+/* @brief Density proportional to a step function over [0, 1)^2, sampled as a
+* marginal density in v and a conditional density in u.
+*/
+class PiecewiseConstant2D {
+ public:
+  PiecewiseConstant2D() = default;
+  // func[v * nu + u]
+  PiecewiseConstant2D(const float *func, int nu, int nv);
+
+  glm::vec2 Sample(glm::vec2 u, float *pdf) const;
+  [[nodiscard]] float GetPdf(glm::vec2 p) const;
+  [[nodiscard]] float GetIntegral() const {
+    return marginal_.GetIntegral();
+  }
+
+ private:
+  std::vector<PiecewiseConstant1D> conditional_;
+  PiecewiseConstant1D marginal_;
+};
+}  // namespace sparks
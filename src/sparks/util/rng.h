@@ -0,0 +1,63 @@
+#pragma once
+#include "cstdint"
+
+namespace sparks {
+/* @brief PCG32 generator (O'Neill 2014), 16 bytes of state.
+* Meets UniformRandomBitGenerator, so it works with the <random> distributions.
+*/
+class Rng {
+ public:
+  using result_type = uint32_t;
+
+  Rng() = default;
+  explicit Rng(uint64_t seed, uint64_t stream = 0) {
+    Seed(seed, stream);
+  }
+
+  void Seed(uint64_t seed, uint64_t stream = 0) {
+    state_ = 0;
+    inc_ = (stream << 1u) | 1u;
+    (*this)();
+    state_ += seed;
+    (*this)();
+  }
+
+  static constexpr result_type min() {
+    return 0;
+  }
+  static constexpr result_type max() {
+    return 0xffffffffu;
+  }
+
+  result_type operator()() {
+    uint64_t old_state = state_;
+    state_ = old_state * 6364136223846793005ull + inc_;
+    auto xorshifted = uint32_t(((old_state >> 18u) ^ old_state) >> 27u);
+    auto rot = uint32_t(old_state >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+  }
+
+  // Uniform in [0, 1)
+  float Uniform() {
+    return float((*this)() >> 8) * (1.0f / 16777216.0f);
+  }
+
+ private:
+  uint64_t state_{0x853c49e6748fea9bull};
+  uint64_t inc_{0xda3e39cb94b95bdbull};
+};
+
+// splitmix64 finalizer, a bijective 64 bit hash
+inline uint64_t MixBits(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+/* @brief Seed of the random numbers of one sample of one pixel. Counter-based,
+* so a sample gets the same numbers whichever thread renders it and when.
+*/
+inline uint64_t GetSampleSeed(uint32_t x, uint32_t y, uint32_t sample) {
+  return MixBits(MixBits(uint64_t(x) << 32 | y) + sample);
+}
+}  // namespace sparks
@@ -1,18 +1,20 @@
 #include "sample.h"
+#include "sparks/util/check.h"
 #include "sparks/util/util.h"
 #include <random>
 #include <glm/gtx/string_cast.hpp>
 
 namespace sparks {
-glm::vec3 hemisphere_sample(const glm::vec3 &normal, std::mt19937& rng)
+glm::vec3 hemisphere_sample(const glm::vec3 &normal, Sampler& sampler)
 {
-	return normal2world(normal, hemisphere_sample_std(rng));
+	return normal2world(normal, hemisphere_sample_std(sampler));
 }
-glm::vec3 hemisphere_sample_std(std::mt19937& rng)
+glm::vec3 hemisphere_sample_std(Sampler& sampler)
 {
 	// Based on https://ameye.dev/notes/sampling-the-hemisphere/
-	float eps0 = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
-	float eps1 = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+	glm::vec2 eps = sampler.Get2D();
+	float eps0 = eps.x;
+	float eps1 = eps.y;
 	float cos_theta = eps0;
 	float sin_theta = glm::sqrt(1 - cos_theta * cos_theta);
 	float phi = 2 * sparks::PI * eps1;
@@ -22,9 +24,7 @@ glm::vec3 hemisphere_sample_std(std::mt19937& rng)
 }
 glm::vec3 normal2world(const glm::vec3 & normal, const glm::vec3 & p)
 {
-	if (glm::abs(glm::length(normal) - 1.0f) > 1e-3) {
-		throw "Unnormalized normal!";
-	}
+	SPARKS_CHECK_NORMALIZED(normal, 1e-3f, "Unnormalized normal");
 	if (glm::distance(normal, glm::vec3{ 0,0,1 }) < 1e-9) { // normal is same as positive z, no need to rotate
 		return p;
 	}
@@ -42,10 +42,10 @@ glm::vec3 normal2world(const glm::vec3 & normal, const glm::vec3 & p)
 }
 
 // Based on https://www.pbr-book.org/3ed-2018/Monte_Carlo_Integration/2D_Sampling_with_Multidimensional_Transformations#ConcentricSampleDisk
-glm::vec3 hemisphere_sample_cosine_weighted(const glm::vec3& normal, std::mt19937& rng, float* pdf)
+glm::vec3 hemisphere_sample_cosine_weighted(const glm::vec3& normal, Sampler& sampler, float* pdf)
 {
 	// Sample on standard unit hemisphere (normal = (0,0,1))
-	glm::vec2 u = disk_sample(rng);
+	glm::vec2 u = disk_sample(sampler);
 	float z = std::sqrt(std::max(0.0f, 1 - u.x * u.x - u.y * u.y));
 
 	glm::vec3 p_std = glm::vec3{ u.x, u.y, z };
@@ -58,11 +58,12 @@ glm::vec3 hemisphere_sample_cosine_weighted(const glm::vec3& normal, std::mt1993
 }
 
 // Based on https://www.pbr-book.org/3ed-2018/Monte_Carlo_Integration/2D_Sampling_with_Multidimensional_Transformations#ConcentricSampleDisk
-glm::vec2 disk_sample(std::mt19937& rng)
+glm::vec2 disk_sample(Sampler& sampler)
 {
 	// Uniform sampling in [-1,1]x[-1,1]
-	float x = std::uniform_real_distribution<float>(-1.0f, 1.0f)(rng);
-	float y = std::uniform_real_distribution<float>(-1.0f, 1.0f)(rng);
+	glm::vec2 u = sampler.Get2D() * 2.0f - 1.0f;
+	float x = u.x;
+	float y = u.y;
 
 	if (std::abs(x) < 1e-5 && std::abs(y) < 1e-5) {
 		return glm::vec2{ 0.0f };
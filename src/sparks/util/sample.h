@@ -1,17 +1,18 @@
 #pragma once
 #include "glm/glm.hpp"
 #include <random>
+#include "sparks/util/sampler.h"
 
 namespace sparks {
 /* @brief Sample from a unit hemisphere.
 * @param normal: The normal of the point, used to determine the hemisphere
 * @return sampled ray. Currently adopt uniform sampling
 */
-glm::vec3 hemisphere_sample(const glm::vec3 &normal, std::mt19937& rng);
+glm::vec3 hemisphere_sample(const glm::vec3 &normal, Sampler& sampler);
 
 /* @brief Unit hemisphere sampling on standard coordinates (x,y,z), with z >=0
 */
-glm::vec3 hemisphere_sample_std(std::mt19937& rng);
+glm::vec3 hemisphere_sample_std(Sampler& sampler);
 
 /* @brief convert normal space (coordinate) to world space (standard (x,y,z) coordinate)
 */
@@ -22,8 +23,8 @@ glm::vec3 normal2world(const glm::vec3 & normal, const glm::vec3 & p);
 * @param pdf: Return the pdf of sampled point
 * @return sampled ray. Currently adopt uniform sampling
 */
-glm::vec3 hemisphere_sample_cosine_weighted(const glm::vec3& normal, std::mt19937& rng, float* pdf);
+glm::vec3 hemisphere_sample_cosine_weighted(const glm::vec3& normal, Sampler& sampler, float* pdf);
 
 // @brief Uniform sample a unit disk
-glm::vec2 disk_sample(std::mt19937& rng);
+glm::vec2 disk_sample(Sampler& sampler);
 } // namespace sparks
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "sparks/util/sampler.h"
+
+#include "algorithm"
+#include "cmath"
+#include "vector"
+
+namespace sparks {
+namespace {
+constexpr uint32_t kSobolDimensions = 4; // Size of the padded blocks
+constexpr uint32_t kHaltonDimensions = 32;
+constexpr uint32_t kHaltonBases[kHaltonDimensions] = {
+  2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+  59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+constexpr int kBlueNoiseSize = 64;
+constexpr uint32_t kBlueNoiseSeed = 0x9e3779b9u; // Scramble shared by all pixels
+
+/* Generator matrices of the first 4 Sobol dimensions, from the primitive
+* polynomials and direction numbers of Joe and Kuo (2008).
+*/
+struct SobolMatrices {
+  uint32_t v[kSobolDimensions][32]{};
+
+  SobolMatrices() {
+    const uint32_t degree[kSobolDimensions] = {0, 1, 2, 3};
+    const uint32_t coefficients[kSobolDimensions] = {0, 0, 1, 1};
+    const uint32_t m[kSobolDimensions][3] = {{0}, {1}, {1, 3}, {1, 3, 1}};
+    for (uint32_t i = 0; i < 32; i++) {
+      v[0][i] = 1u << (31 - i);
+    }
+    for (uint32_t d = 1; d < kSobolDimensions; d++) {
+      uint32_t s = degree[d];
+      for (uint32_t i = 0; i < s; i++) {
+        v[d][i] = m[d][i] << (31 - i);
+      }
+      for (uint32_t i = s; i < 32; i++) {
+        v[d][i] = v[d][i - s] ^ (v[d][i - s] >> s);
+        for (uint32_t k = 1; k < s; k++) {
+          if ((coefficients[d] >> (s - 1 - k)) & 1u) {
+            v[d][i] ^= v[d][i - k];
+          }
+        }
+      }
+    }
+  }
+};
+
+const SobolMatrices kSobolMatrices;
+
+uint32_t Sobol(uint32_t index, uint32_t dimension) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; index; index >>= 1, i++) {
+    if (index & 1u) {
+      result ^= kSobolMatrices.v[dimension][i];
+    }
+  }
+  return result;
+}
+
+uint32_t ReverseBits(uint32_t x) {
+  x = (x << 16) | (x >> 16);
+  x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+  x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+  x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+  x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+  return x;
+}
+
+// Hash-based Owen scrambling (Burley 2020)
+uint32_t NestedUniformScramble(uint32_t x, uint32_t seed) {
+  x = ReverseBits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return ReverseBits(x);
+}
+
+uint32_t HashCombine(uint32_t seed, uint32_t value) {
+  return uint32_t(MixBits(uint64_t(seed) << 32 | value));
+}
+
+float ToFloat(uint32_t bits) {
+  return float(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+float RadicalInverse(uint32_t index, uint32_t base) {
+  float inv_base = 1.0f / float(base);
+  float inv_base_n = 1.0f;
+  uint32_t reversed = 0;
+  while (index) {
+    uint32_t next = index / base;
+    reversed = reversed * base + (index - next * base);
+    inv_base_n *= inv_base;
+    index = next;
+  }
+  return std::min(float(reversed) * inv_base_n, 0x1.fffffep-1f);
+}
+
+/* 64x64 tileable blue-noise ranks, made by void and cluster (Ulichney 1993):
+* each pixel in turn goes to the largest void, the free pixel of least energy.
+*/
+std::vector<float> MakeBlueNoise() {
+  const int n = kBlueNoiseSize * kBlueNoiseSize;
+  const float sigma = 1.9f;
+  std::vector<float> kernel(n);
+  for (int y = 0; y < kBlueNoiseSize; y++) {
+    for (int x = 0; x < kBlueNoiseSize; x++) {
+      // Distances wrap around, so the tile repeats without seams
+      float dx = float(std::min(x, kBlueNoiseSize - x));
+      float dy = float(std::min(y, kBlueNoiseSize - y));
+      kernel[y * kBlueNoiseSize + x] =
+          std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+    }
+  }
+  std::vector<float> energy(n, 0.0f);
+  std::vector<float> ranks(n, -1.0f);
+  for (int rank = 0; rank < n; rank++) {
+    int best = -1;
+    for (int i = 0; i < n; i++) {
+      if (ranks[i] < 0.0f && (best < 0 || energy[i] < energy[best])) {
+        best = i;
+      }
+    }
+    ranks[best] = (float(rank) + 0.5f) / float(n);
+    int bx = best % kBlueNoiseSize;
+    int by = best / kBlueNoiseSize;
+    for (int y = 0; y < kBlueNoiseSize; y++) {
+      int ky = (y - by + kBlueNoiseSize) % kBlueNoiseSize;
+      for (int x = 0; x < kBlueNoiseSize; x++) {
+        int kx = (x - bx + kBlueNoiseSize) % kBlueNoiseSize;
+        energy[y * kBlueNoiseSize + x] += kernel[ky * kBlueNoiseSize + kx];
+      }
+    }
+  }
+  return ranks;
+}
+
+const std::vector<float> &GetBlueNoiseTile() {
+  static const std::vector<float> tile = MakeBlueNoise();
+  return tile;
+}
+}  // namespace
+
+Sampler::Sampler(SamplerType type, bool blue_noise)
+    : type_(type), blue_noise_(blue_noise) {
+  if (blue_noise_ && type_ != SAMPLER_INDEPENDENT) {
+    GetBlueNoiseTile(); // Build the tile before rendering starts
+  }
+}
+
+void Sampler::StartSample(uint32_t x, uint32_t y, uint32_t sample) {
+  x_ = x;
+  y_ = y;
+  sample_ = sample;
+  dimension_ = 0;
+  uint64_t pixel_seed = GetSampleSeed(x, y, 0);
+  seed_ = blue_noise_ ? kBlueNoiseSeed : uint32_t(pixel_seed);
+  rng_.Seed(GetSampleSeed(x, y, sample));
+}
+
+float Sampler::Get1D() {
+  uint32_t dimension = dimension_++;
+  float u;
+  switch (type_) {
+  case SAMPLER_SOBOL:
+    u = GetSobol_(dimension);
+    break;
+  case SAMPLER_HALTON:
+    if (dimension >= kHaltonDimensions) {
+      // The large bases correlate badly, past them samples are independent
+      return rng_.Uniform();
+    }
+    u = GetHalton_(dimension);
+    break;
+  default:
+    return rng_.Uniform();
+  }
+  if (blue_noise_) {
+    u += GetBlueNoise_(dimension);
+    u = u >= 1.0f ? u - 1.0f : u;
+    u = std::min(u, 0x1.fffffep-1f);
+  }
+  return u;
+}
+
+glm::vec2 Sampler::Get2D() {
+  if (type_ == SAMPLER_SOBOL && dimension_ % kSobolDimensions == kSobolDimensions - 1) {
+    dimension_++; // Keep both dimensions in one block, stratified together
+  }
+  float u = Get1D();
+  float v = Get1D();
+  return {u, v};
+}
+
+float Sampler::GetSobol_(uint32_t dimension) const {
+  // Padding: each block of dimensions shuffles the sample order on its own
+  uint32_t block_seed = HashCombine(seed_, dimension / kSobolDimensions);
+  uint32_t index = NestedUniformScramble(sample_, block_seed);
+  uint32_t d = dimension % kSobolDimensions;
+  return ToFloat(NestedUniformScramble(Sobol(index, d), HashCombine(block_seed, d + 1)));
+}
+
+float Sampler::GetHalton_(uint32_t dimension) const {
+  // Cranley-Patterson rotation, a random offset modulo 1
+  float u = RadicalInverse(sample_, kHaltonBases[dimension]) +
+            ToFloat(HashCombine(seed_, dimension));
+  u = u >= 1.0f ? u - 1.0f : u;
+  return std::min(u, 0x1.fffffep-1f);
+}
+
+float Sampler::GetBlueNoise_(uint32_t dimension) const {
+  // Dimensions read the tile at different toroidal offsets
+  uint32_t offset = HashCombine(kBlueNoiseSeed, dimension);
+  uint32_t x = (x_ + (offset & 0xffffu)) % kBlueNoiseSize;
+  uint32_t y = (y_ + (offset >> 16)) % kBlueNoiseSize;
+  return GetBlueNoiseTile()[y * kBlueNoiseSize + x];
+}
+}  // namespace sparks
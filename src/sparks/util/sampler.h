@@ -0,0 +1,60 @@
+#pragma once
+#include "cstdint"
+#include "glm/glm.hpp"
+#include "sparks/util/rng.h"
+
+namespace sparks {
+enum SamplerType : int {
+  SAMPLER_INDEPENDENT = 0, // PCG32 random numbers
+  SAMPLER_SOBOL = 1,       // Owen-scrambled Sobol, padded in blocks of 4 dimensions
+  SAMPLER_HALTON = 2       // Randomly rotated Halton
+};
+
+/* @brief Supplies the sample values of one pixel sample, one dimension at a
+* time. Dimensions are drawn in a fixed order (camera first, then the path),
+* so sample i of a pixel always gets the same point of the sequence.
+* With blue_noise, every pixel shares one sequence and is decorrelated by a
+* blue-noise rotation, which pushes the remaining error to high frequencies.
+* Also a UniformRandomBitGenerator, each call consuming one dimension.
+*/
+class Sampler {
+ public:
+  using result_type = uint32_t;
+
+  Sampler() = default;
+  explicit Sampler(SamplerType type, bool blue_noise = false);
+
+  // Start sample `sample` of pixel (x, y) at dimension 0
+  void StartSample(uint32_t x, uint32_t y, uint32_t sample);
+
+  // Uniform in [0, 1)
+  float Get1D();
+  // Two dimensions of the same 4 dimensional Sobol block
+  glm::vec2 Get2D();
+
+  static constexpr result_type min() {
+    return 0;
+  }
+  static constexpr result_type max() {
+    return 0xffffffffu;
+  }
+  result_type operator()() {
+    return uint32_t(double(Get1D()) * 4294967296.0);
+  }
+
+ private:
+  SamplerType type_{SAMPLER_INDEPENDENT};
+  bool blue_noise_{false};
+  uint32_t x_{0};
+  uint32_t y_{0};
+  uint32_t sample_{0};
+  uint32_t dimension_{0};
+  uint32_t seed_{0}; // Scrambles the sequence, per pixel unless blue_noise_
+  Rng rng_;          // Independent samples, and Halton beyond its dimensions
+
+  [[nodiscard]] float GetSobol_(uint32_t dimension) const;
+  [[nodiscard]] float GetHalton_(uint32_t dimension) const;
+  // Blue-noise rotation of this pixel for a dimension
+  [[nodiscard]] float GetBlueNoise_(uint32_t dimension) const;
+};
+}  // namespace sparks